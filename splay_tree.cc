@@ -1,421 +1,2632 @@
 #include <iostream>
 #include <vector>
+#include <string>
 #include <algorithm>
 #include <cassert>
+#include <memory>
+#include <climits>
+#include <limits>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cstdint>
+#include <type_traits>
+#include <atomic>
+#include <new>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#if defined(SPLAY_BENCHMARK) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
-const int MAXN = 200005;
+const int CHUNK_BITS = 16;              // Each arena chunk holds 2^CHUNK_BITS nodes
+const int CHUNK_SIZE = 1 << CHUNK_BITS;
+const int SMALL_CHUNK_BITS = 10;        // Chunk size for trees with 16-bit node IDs
+const int FIRST_CHUNK_BITS = 6;         // An arena starts with a chunk of 2^FIRST_CHUNK_BITS nodes
+
+// --- Policies ---
+// A policy tells the tree what it stores and maintains. It provides:
+//   key_type                   Type of a sequence element
+//   agg_type                   Aggregate over a subtree (a monoid)
+//   lazy_type                  Pending action on a subtree
+//   identity()                 Aggregate of the empty sequence
+//   lift(key)                  Aggregate of a single element
+//   combine(a, b)              Aggregate of a followed by b
+//   reverse(agg)               Adjusts agg after the order of its elements is reversed
+//   lazy_identity()            The action that changes nothing
+//   has_lazy(f)                False if f is the identity action
+//   apply(key, agg, sz, f)     Applies f to an element and to an aggregate of sz elements
+//   compose(pending, f)        Makes pending the action "pending, then f"
+// Everything is static, so the tree code is specialized at compile time.
+
+// --- Sum Arithmetic ---
+// Sums are kept in splay_sum_t unless a policy is instantiated with another type.
+// Select its width at compile time with -DSPLAY_SUM_BITS=32, 64 (default) or 128.
+// With -DSPLAY_CHECKED_ARITHMETIC, every sum and element computation is checked and an
+// overflow is reported and aborts instead of wrapping silently.
+#ifndef SPLAY_SUM_BITS
+#define SPLAY_SUM_BITS 64
+#endif
+
+#if SPLAY_SUM_BITS == 32
+typedef int splay_sum_t;
+#elif SPLAY_SUM_BITS == 64
+typedef long long splay_sum_t;
+#elif SPLAY_SUM_BITS == 128
+typedef __int128 splay_sum_t;
+
+ostream& operator<<(ostream& os, __int128 v) {
+    if (v < 0) {
+        os << '-';
+        v = -v;
+    }
+    if (v >= 10) os << v / 10;
+    return os << (char)('0' + (int)(v % 10));
+}
+#else
+#error "SPLAY_SUM_BITS must be 32, 64 or 128"
+#endif
+
+template <class T>
+T checked_add(T a, T b) {
+#ifdef SPLAY_CHECKED_ARITHMETIC
+    T res;
+    if (__builtin_add_overflow(a, b, &res)) {
+        cerr << "splay tree: arithmetic overflow in addition" << endl;
+        abort();
+    }
+    return res;
+#else
+    return a + b;
+#endif
+}
 
-// Represents a node in the splay tree.
-struct Node {
-    int pa;   // Parent node ID
-    int ch[2]; // Left (0) and Right (1) child IDs
-    int key;  // Value of the current element
-    int sum;  // Sum of elements in the subtree rooted at this node
-    int lazy; // Additive lazy tag for range updates
-    int sz;   // Size of the subtree rooted at this node (including itself)
+template <class T>
+T checked_mul(T a, T b) {
+#ifdef SPLAY_CHECKED_ARITHMETIC
+    T res;
+    if (__builtin_mul_overflow(a, b, &res)) {
+        cerr << "splay tree: arithmetic overflow in multiplication" << endl;
+        abort();
+    }
+    return res;
+#else
+    return a * b;
+#endif
+}
 
-    Node() : pa(0), key(0), sum(0), lazy(0), sz(0) {
-        ch[0] = ch[1] = 0;
+// Integer sums with an additive lazy tag.
+template <class Sum = splay_sum_t>
+struct SumAddPolicy {
+    typedef int key_type;
+    struct agg_type {
+        Sum sum;
+    };
+    typedef int lazy_type; // Value to add
+
+    static agg_type identity() { return {0}; }
+    static agg_type lift(int key) { return {key}; }
+    static agg_type combine(const agg_type& a, const agg_type& b) { return {checked_add(a.sum, b.sum)}; }
+    static void reverse(agg_type&) {}
+
+    static lazy_type lazy_identity() { return 0; }
+    static bool has_lazy(int f) { return f != 0; }
+    static void apply(int& key, agg_type& agg, long long sz, int f) {
+        key = checked_add(key, f);
+        agg.sum = checked_add(agg.sum, checked_mul((Sum)f, (Sum)sz));
     }
+    static void compose(int& pending, int f) { pending = checked_add(pending, f); }
+
+    static lazy_type add_action(int val) { return val; }
 };
 
+// Integer sum, min and max with an affine lazy action key = mul * key + add.
+template <class Sum = splay_sum_t>
+struct SumMinMaxAffinePolicy {
+    typedef int key_type;
+    struct agg_type {
+        Sum sum;
+        int mn; // INT_MAX for the empty sequence
+        int mx; // INT_MIN for the empty sequence
+    };
+    struct lazy_type {
+        int mul;
+        int add;
+    };
+
+    static agg_type identity() { return {0, INT_MAX, INT_MIN}; }
+    static agg_type lift(int key) { return {key, key, key}; }
+    static agg_type combine(const agg_type& a, const agg_type& b) {
+        return {checked_add(a.sum, b.sum), min(a.mn, b.mn), max(a.mx, b.mx)};
+    }
+    static void reverse(agg_type&) {}
+
+    static lazy_type lazy_identity() { return {1, 0}; }
+    static bool has_lazy(const lazy_type& f) { return f.mul != 1 || f.add != 0; }
+    static void apply(int& key, agg_type& agg, long long sz, const lazy_type& f) {
+        key = checked_add(checked_mul(f.mul, key), f.add);
+        agg.sum = checked_add(checked_mul((Sum)f.mul, agg.sum), checked_mul((Sum)f.add, (Sum)sz));
+        agg.mn = checked_add(checked_mul(f.mul, agg.mn), f.add);
+        agg.mx = checked_add(checked_mul(f.mul, agg.mx), f.add);
+        if (f.mul < 0) swap(agg.mn, agg.mx);
+    }
+    static void compose(lazy_type& pending, const lazy_type& f) {
+        pending.mul = checked_mul(f.mul, pending.mul);
+        pending.add = checked_add(checked_mul(f.mul, pending.add), f.add);
+    }
 
-Node tree[MAXN];  // Array to store all nodes in the splay tree
-int root;         // Root of the splay tree
-int tot_nodes;    // Total nodes allocated in the tree array
+    static lazy_type add_action(int val) { return {1, val}; }
+    static lazy_type affine_action(int mul, int add) { return {mul, add}; }
+};
 
-// --- Core Splay Tree Operations ---
+// Polynomial hash of the sequence (mod 2^64) in both directions, without range updates.
+// Comparing the two directions tells whether a range is a palindrome.
+struct PolyHashPolicy {
+    static const unsigned long long BASE = 1000003;
+
+    typedef int key_type;
+    struct agg_type {
+        unsigned long long fwd; // Hash of the elements read left to right
+        unsigned long long bwd; // Hash of the elements read right to left
+        unsigned long long pw;  // BASE^length
+    };
+    struct lazy_type {};
+
+    static agg_type identity() { return {0, 0, 1}; }
+    static agg_type lift(int key) { return {(unsigned long long)key, (unsigned long long)key, BASE}; }
+    static agg_type combine(const agg_type& a, const agg_type& b) {
+        return {a.fwd * b.pw + b.fwd, b.bwd * a.pw + a.bwd, a.pw * b.pw};
+    }
+    static void reverse(agg_type& agg) { swap(agg.fwd, agg.bwd); }
 
-// Updates the size and sum of node x based on its children's information.
-void push_up(int x) {
-    if (!x) return;
-    tree[x].sz = tree[tree[x].ch[0]].sz + tree[tree[x].ch[1]].sz + 1;
-    tree[x].sum = tree[tree[x].ch[0]].sum + tree[tree[x].ch[1]].sum + tree[x].key;
-}
+    static lazy_type lazy_identity() { return {}; }
+    static bool has_lazy(const lazy_type&) { return false; }
+    static void apply(int&, agg_type&, long long, const lazy_type&) {}
+    static void compose(lazy_type&, const lazy_type&) {}
+};
 
-// Apply lazy tag value to node x
-void apply_lazy_value(int x, int val) {
-    if (!x) return;
-    tree[x].key += val;
-    tree[x].sum += val * tree[x].sz;
-    tree[x].lazy += val;
-}
 
-// Pushes down the lazy tag from node x to its children.
-void push_down(int x) {
-    if (!x || tree[x].lazy == 0) return;
-    if (tree[x].ch[0]) apply_lazy_value(tree[x].ch[0], tree[x].lazy);
-    if (tree[x].ch[1]) apply_lazy_value(tree[x].ch[1], tree[x].lazy);
-    tree[x].lazy = 0;
-}
+// --- Chunk Allocators ---
+// A chunk allocator provides allocate<Node>(count), returning count constructed nodes,
+// deallocate<Node>(p, count), destroying and releasing them, and chunk_bits<Node>(bits),
+// the log2 of the chunk size it wants given the size the layout asks for.
 
-// Get which child x is of its parent (0 for left, 1 for right)
-int get_child_type(int x) {
-    return tree[tree[x].pa].ch[1] == x;
-}
+// Chunks from the ordinary heap.
+struct HeapChunkAllocator {
+    template <class Node>
+    static constexpr int chunk_bits(int requested) { return requested; }
+    template <class Node>
+    static Node* allocate(size_t count) { return new Node[count]; }
+    template <class Node>
+    static void deallocate(Node* p, size_t) { delete[] p; }
+};
 
-// Rotate node x up one level
-void rotate(int x) {
-    int y = tree[x].pa;
-    int z = tree[y].pa;
-    int x_type = get_child_type(x);
-    int y_type = get_child_type(y);
+// Chunks mapped on 2 MB pages, so a random descent through 10^7 nodes needs far fewer TLB
+// entries. Full chunks are enlarged until they fill whole huge pages exactly, and each tries,
+// in order: a MAP_HUGETLB mapping from the reserved huge page pool, then an aligned mapping with
+// madvise(MADV_HUGEPAGE) for transparent huge pages, then whatever pages the kernel gives.
+// Smaller chunks (the arena's first one while it grows) would leave padding and come from the heap.
+// Outside Linux this is the heap allocator. The counters record which backing chunks got.
+struct HugePageChunkAllocator {
+    static const int HUGE_PAGE_BITS = 21;
+    static const size_t HUGE_PAGE_SIZE = (size_t)1 << HUGE_PAGE_BITS;
+
+    inline static atomic<size_t> hugetlb_chunks{0}; // Chunks from the huge page pool
+    inline static atomic<size_t> advised_chunks{0}; // Chunks left to transparent huge pages
+
+#ifdef __linux__
+    // 2^bits nodes of s bytes fill whole huge pages once bits + (trailing zero bits of s)
+    // reaches HUGE_PAGE_BITS, so no part of a mapping is left as padding.
+    template <class Node>
+    static constexpr int chunk_bits(int requested) {
+        int size_bits = 0;
+        while (size_bits < HUGE_PAGE_BITS && !((sizeof(Node) >> size_bits) & 1)) ++size_bits;
+        return max(requested, HUGE_PAGE_BITS - size_bits);
+    }
 
-    if (z) tree[z].ch[y_type] = x;
-    tree[x].pa = z;
+    static bool fills_huge_pages(size_t bytes) { return bytes % HUGE_PAGE_SIZE == 0; }
 
-    tree[y].ch[x_type] = tree[x].ch[x_type ^ 1];
-    if (tree[x].ch[x_type ^ 1]) tree[tree[x].ch[x_type ^ 1]].pa = y;
+    static void* map_pages(size_t size) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            ++hugetlb_chunks;
+            return p;
+        }
+        // Over-map by one huge page and trim, so the chunk starts on a huge page boundary.
+        p = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw bad_alloc();
+        char* base = (char*)p;
+        char* aligned = (char*)(((uintptr_t)base + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+        if (aligned > base) munmap(base, aligned - base);
+        munmap(aligned + size, base + HUGE_PAGE_SIZE - aligned);
+        if (madvise(aligned, size, MADV_HUGEPAGE) == 0) ++advised_chunks;
+        return aligned;
+    }
 
-    tree[x].ch[x_type ^ 1] = y;
-    tree[y].pa = x;
+    template <class Node>
+    static Node* allocate(size_t count) {
+        if (!fills_huge_pages(count * sizeof(Node))) return HeapChunkAllocator::allocate<Node>(count);
+        Node* p = (Node*)map_pages(count * sizeof(Node));
+        for (size_t i = 0; i < count; ++i) new (p + i) Node();
+        return p;
+    }
 
-    push_up(y);
-    push_up(x);
-}
+    template <class Node>
+    static void deallocate(Node* p, size_t count) {
+        if (!fills_huge_pages(count * sizeof(Node))) return HeapChunkAllocator::deallocate(p, count);
+        for (size_t i = 0; i < count; ++i) p[i].~Node();
+        munmap(p, count * sizeof(Node));
+    }
+#else
+    template <class Node>
+    static constexpr int chunk_bits(int requested) { return requested; }
+    template <class Node>
+    static Node* allocate(size_t count) { return HeapChunkAllocator::allocate<Node>(count); }
+    template <class Node>
+    static void deallocate(Node* p, size_t count) { HeapChunkAllocator::deallocate(p, count); }
+#endif
+};
 
-// Splay node x to be a child of 'goal_pa' (or root if goal_pa is 0)
-void splay(int x, int goal_pa = 0) {
-    while (tree[x].pa != goal_pa) {
-        int y = tree[x].pa;
-        int z = tree[y].pa;
 
-        if (z != goal_pa) push_down(z); 
-        push_down(y);                   
-        push_down(x);
+// Growable node storage made of chunks of 2^ChunkBits nodes, or more if the chunk allocator
+// asks for bigger chunks. So that an empty arena costs next to nothing, it starts with a
+// chunk of 2^FIRST_CHUNK_BITS nodes that doubles (and moves) until it reaches the full size.
+// Full chunks are never moved, but growing the first one is, so only node IDs are stable
+// across reserve(); references to nodes must not be held over it.
+template <class Node, int ChunkBits = CHUNK_BITS, class ChunkAllocator = HeapChunkAllocator>
+struct NodeArena {
+    static const int SHIFT = ChunkAllocator::template chunk_bits<Node>(ChunkBits);
+    static const size_t CHUNK_NODES = (size_t)1 << SHIFT;
 
+    struct ChunkDeleter {
+        size_t count; // Nodes in the chunk
+        void operator()(Node* p) const { ChunkAllocator::deallocate(p, count); }
+    };
 
-        if (z == goal_pa) { // Zig step
-            rotate(x);
-        } else {
-            if (get_child_type(x) == get_child_type(y)) { // Zig-Zig step
-                rotate(y);
-                rotate(x);
-            } else { // Zig-Zag step
-                rotate(x);
+    vector<unique_ptr<Node[], ChunkDeleter>> chunks;
+    size_t first_nodes = 0; // Size of chunks[0] while it is the only chunk
+
+    NodeArena() { reserve(1); } // Node 0 (the null sentinel) always exists
+
+    Node& operator[](size_t x) {
+        return chunks[x >> SHIFT][x & (CHUNK_NODES - 1)];
+    }
+
+    // Number of node slots currently backed by memory.
+    size_t capacity() const { return chunks.size() <= 1 ? first_nodes : chunks.size() << SHIFT; }
+
+    // Grows the arena until at least n slots (IDs 0..n-1) are available.
+    void reserve(size_t n) {
+        while (capacity() < n) {
+            if (chunks.empty() || first_nodes < CHUNK_NODES) {
+                int first_bits = SHIFT < FIRST_CHUNK_BITS ? SHIFT : FIRST_CHUNK_BITS;
+                size_t count = chunks.empty() ? (size_t)1 << first_bits : first_nodes * 2;
+                unique_ptr<Node[], ChunkDeleter> grown(ChunkAllocator::template allocate<Node>(count),
+                                                       ChunkDeleter{count});
+                if (!chunks.empty()) copy(chunks[0].get(), chunks[0].get() + first_nodes, grown.get());
+                else chunks.emplace_back();
+                chunks[0] = move(grown);
+                first_nodes = count;
+            } else {
+                chunks.emplace_back(ChunkAllocator::template allocate<Node>(CHUNK_NODES),
+                                    ChunkDeleter{CHUNK_NODES});
+            }
+        }
+    }
+};
+
+// --- Node Layouts ---
+// A node has two halves:
+//   Links    pa, ch, sz and tag flags: everything a descent by rank reads
+//   Payload  key, aggregate and lazy action: read only when values are needed
+// A layout stores them and provides links(x), payload(x), capacity() and reserve(n).
+// ChunkBits sets the arena chunk size and ChunkAllocator where chunks come from (see NodeArena).
+
+// Array of structs: both halves of a node are stored together.
+struct AosLayout {
+    template <class Links, class Payload, int ChunkBits = CHUNK_BITS,
+              class ChunkAllocator = HeapChunkAllocator>
+    struct Storage {
+        struct Node : Links, Payload {};
+        NodeArena<Node, ChunkBits, ChunkAllocator> nodes;
+
+        Links& links(size_t x) { return nodes[x]; }
+        Payload& payload(size_t x) { return nodes[x]; }
+        size_t capacity() const { return nodes.capacity(); }
+        void reserve(size_t n) { nodes.reserve(n); }
+    };
+};
+
+// Hot/cold split: links and payloads live in two arenas indexed by the same node ID,
+// so find_kth and the splay descents pull only links into cache.
+struct SplitLayout {
+    template <class Links, class Payload, int ChunkBits = CHUNK_BITS,
+              class ChunkAllocator = HeapChunkAllocator>
+    struct Storage {
+        NodeArena<Links, ChunkBits, ChunkAllocator> hot;
+        NodeArena<Payload, ChunkBits, ChunkAllocator> cold;
+
+        Links& links(size_t x) { return hot[x]; }
+        Payload& payload(size_t x) { return cold[x]; }
+        size_t capacity() const { return min(hot.capacity(), cold.capacity()); }
+        void reserve(size_t n) {
+            hot.reserve(n);
+            cold.reserve(n);
+        }
+    };
+};
+
+// Any layout with its arena chunks on huge pages, e.g. HugePageLayout<SplitLayout>.
+// Meant for large trees: the first chunk already spans several megabytes.
+template <class Layout = AosLayout>
+struct HugePageLayout {
+    template <class Links, class Payload, int ChunkBits = CHUNK_BITS>
+    struct Storage : Layout::template Storage<Links, Payload, ChunkBits, HugePageChunkAllocator> {
+        static_assert(ChunkBits != SMALL_CHUNK_BITS, "16-bit trees are too small for huge page chunks");
+    };
+};
+
+// Node orders that SplayTree::compact can renumber live nodes into.
+enum NodeOrder {
+    BFS_ORDER, // Level by level from the root: the top levels share a few cache lines
+    VEB_ORDER  // van Emde Boas: every subtree of about sqrt(height) levels is contiguous
+};
+
+
+// Implicit splay tree over a sequence, specialized by a policy, a node layout (see above)
+// and a signed node ID type. Index bounds the tree size (int16_t: 32767 nodes) and sets the
+// width of pa, ch and sz, so narrower IDs pack more Links into each cache line.
+// Each instance holds one sequence. Its nodes live in a NodePool that several instances
+// may share (see the constructors); instances on different pools are fully independent
+// and may be used from different threads. Instances sharing a pool must not be used
+// concurrently.
+template <class Policy, class Layout = AosLayout, class Index = int>
+struct SplayTree {
+    typedef typename Policy::key_type key_type;
+    typedef typename Policy::agg_type agg_type;
+    typedef typename Policy::lazy_type lazy_type;
+
+    // Topology half of a node in the splay tree.
+    struct Links {
+        Index pa;    // Parent node ID
+        Index ch[2]; // Left (0) and Right (1) child IDs
+        Index sz;    // Size of the subtree rooted at this node (including itself)
+        bool rev; // Reversal tag: children of this node are swapped, descendants are pending
+        bool tagged; // A lazy action is pending for the descendants (see Payload::lazy)
+
+        Links() : pa(0), sz(0), rev(false), tagged(false) {
+            ch[0] = ch[1] = 0;
+        }
+    };
+
+    // Value half of a node in the splay tree.
+    struct Payload {
+        key_type key;   // Value of the current element
+        agg_type agg;   // Aggregate of the elements in the subtree rooted at this node
+        lazy_type lazy; // Lazy action pending for the descendants of this node
+
+        Payload() : key(), agg(Policy::identity()), lazy(Policy::lazy_identity()) {}
+    };
+
+    static_assert(is_integral<Index>::value && is_signed<Index>::value, "Index must be a signed integer");
+
+    // 16-bit trees hold at most 32767 nodes, so they use small chunks.
+    typedef typename Layout::template Storage<Links, Payload,
+                                              sizeof(Index) <= 2 ? SMALL_CHUNK_BITS : CHUNK_BITS> Storage;
+
+    // Node storage and allocator state, shared by every instance built on it.
+    struct NodePool {
+        Storage tree;             // Storage for all nodes in the pool
+        Index tot_nodes = 0;      // Total nodes allocated in the tree array
+        vector<Index> free_nodes; // IDs of deleted nodes available for reuse by new_node
+        size_t instances = 0;     // Live SplayTree instances allocating from the pool
+    };
+
+    shared_ptr<NodePool> pool; // Pool holding this sequence's nodes
+    Index root = 0;            // Root of this sequence's splay tree
+
+    // Creates an empty sequence with a pool of its own. An empty pool holds only the
+    // arena's first, small chunk, so thousands of instances are cheap.
+    SplayTree() : pool(make_shared<NodePool>()) { ++pool->instances; }
+
+    // Creates an empty sequence that allocates from an existing pool, e.g. `other.pool`.
+    explicit SplayTree(shared_ptr<NodePool> shared_pool) : pool(move(shared_pool)) { ++pool->instances; }
+
+    // A sequence owns its nodes, so instances can be moved but not copied.
+    // A moved-from instance is an empty sequence that stays on the same pool.
+    SplayTree(const SplayTree&) = delete;
+    SplayTree& operator=(const SplayTree&) = delete;
+    SplayTree(SplayTree&& other) noexcept : pool(other.pool), root(other.root) {
+        ++pool->instances;
+        other.root = 0;
+    }
+    SplayTree& operator=(SplayTree&& other) noexcept {
+        if (this != &other) {
+            release();
+            --pool->instances;
+            pool = other.pool;
+            ++pool->instances;
+            root = other.root;
+            other.root = 0;
+        }
+        return *this;
+    }
+
+    ~SplayTree() {
+        release();
+        --pool->instances;
+    }
+
+    Links& links(Index x) { return pool->tree.links(x); }
+    Payload& payload(Index x) { return pool->tree.payload(x); }
+
+    // --- Core Splay Tree Operations ---
+
+    // Updates the size and aggregate of node x based on its children's information.
+    void push_up(Index x) {
+        if (!x) return;
+        Links& lx = links(x);
+        Payload& px = payload(x);
+        lx.sz = links(lx.ch[0]).sz + links(lx.ch[1]).sz + 1;
+        px.agg = Policy::combine(Policy::combine(payload(lx.ch[0]).agg, Policy::lift(px.key)),
+                                 payload(lx.ch[1]).agg);
+    }
+
+    // Apply lazy action f to node x
+    // The new action is composed after the one already pending at x.
+    void apply_lazy_value(Index x, const lazy_type& f) {
+        if (!x) return;
+        Links& lx = links(x);
+        Payload& px = payload(x);
+        Policy::apply(px.key, px.agg, lx.sz, f);
+        Policy::compose(px.lazy, f);
+        lx.tagged = true;
+    }
+
+    // Reverse the order of the elements in the subtree of node x
+    void apply_reverse(Index x) {
+        if (!x) return;
+        Links& lx = links(x);
+        swap(lx.ch[0], lx.ch[1]);
+        Policy::reverse(payload(x).agg);
+        lx.rev = !lx.rev;
+    }
+
+    // Pushes down the lazy tags from node x to its children.
+    // Only the links half of x is read unless a tag is pending.
+    void push_down(Index x) {
+        if (!x) return;
+        Links& lx = links(x);
+        if (lx.tagged) {
+            Payload& px = payload(x);
+            if (lx.ch[0]) apply_lazy_value(lx.ch[0], px.lazy);
+            if (lx.ch[1]) apply_lazy_value(lx.ch[1], px.lazy);
+            px.lazy = Policy::lazy_identity();
+            lx.tagged = false;
+        }
+        if (lx.rev) {
+            apply_reverse(lx.ch[0]);
+            apply_reverse(lx.ch[1]);
+            lx.rev = false;
+        }
+    }
+
+    // Get which child x is of its parent (0 for left, 1 for right)
+    int get_child_type(Index x) {
+        return links(links(x).pa).ch[1] == x;
+    }
+
+    // Rotate node x up one level
+    void rotate(Index x) {
+        Index y = links(x).pa;
+        Index z = links(y).pa;
+        int x_type = get_child_type(x);
+        int y_type = get_child_type(y);
+
+        if (z) links(z).ch[y_type] = x;
+        links(x).pa = z;
+
+        links(y).ch[x_type] = links(x).ch[x_type ^ 1];
+        if (links(x).ch[x_type ^ 1]) links(links(x).ch[x_type ^ 1]).pa = y;
+
+        links(x).ch[x_type ^ 1] = y;
+        links(y).pa = x;
+
+        push_up(y);
+        push_up(x);
+    }
+
+    // Splay node x to be a child of 'goal_pa' (or root if goal_pa is 0)
+    void splay(Index x, Index goal_pa = 0) {
+        while (links(x).pa != goal_pa) {
+            Index y = links(x).pa;
+            Index z = links(y).pa;
+
+            if (z != goal_pa) push_down(z); 
+            push_down(y);                   
+            push_down(x);
+
+
+            if (z == goal_pa) { // Zig step
                 rotate(x);
+            } else {
+                if (get_child_type(x) == get_child_type(y)) { // Zig-Zig step
+                    rotate(y);
+                    rotate(x);
+                } else { // Zig-Zag step
+                    rotate(x);
+                    rotate(x);
+                }
             }
         }
+        if (goal_pa == 0) {
+            root = x;
+        }
     }
-    if (goal_pa == 0) {
-        root = x;
+
+
+    // Takes count never-used slots and returns the first ID; they are first..tot_nodes.
+    // Running out of Index values is reported and aborts, like an arithmetic overflow.
+    Index claim_fresh_ids(size_t count) {
+        if (count > (size_t)(numeric_limits<Index>::max() - pool->tot_nodes)) {
+            cerr << "splay tree: node IDs exhausted for this index width" << endl;
+            abort();
+        }
+        Index first = pool->tot_nodes + 1;
+        pool->tot_nodes += (Index)count;
+        if ((size_t)pool->tot_nodes >= pool->tree.capacity()) pool->tree.reserve((size_t)pool->tot_nodes + 1);
+        return first;
     }
-}
 
+    // Creates a new node and returns its ID.
+    // Reuses a node from the free list if one is available, otherwise takes a fresh slot.
+    Index new_node(const key_type& key_val, Index parent_node) {
+        Index x;
+        if (!pool->free_nodes.empty()) {
+            x = pool->free_nodes.back();
+            pool->free_nodes.pop_back();
+            // x may be the root of a freed subtree; its children are reclaimed later.
+            if (links(x).ch[0]) pool->free_nodes.push_back(links(x).ch[0]);
+            if (links(x).ch[1]) pool->free_nodes.push_back(links(x).ch[1]);
+        } else {
+            x = claim_fresh_ids(1);
+        }
+        links(x).pa = parent_node;
+        links(x).ch[0] = links(x).ch[1] = 0;
+        payload(x).key = key_val;
+        payload(x).agg = Policy::lift(key_val);
+        payload(x).lazy = Policy::lazy_identity();
+        links(x).sz = 1;
+        links(x).rev = false;
+        links(x).tagged = false;
+        return x;
+    }
 
-// Creates a new node and returns its ID
-int new_node(int key_val, int parent_node) {
-    tot_nodes++;
-    tree[tot_nodes].pa = parent_node;
-    tree[tot_nodes].ch[0] = tree[tot_nodes].ch[1] = 0;
-    tree[tot_nodes].key = key_val;
-    tree[tot_nodes].sum = key_val;
-    tree[tot_nodes].lazy = 0;
-    tree[tot_nodes].sz = 1;
-    return tot_nodes;
-}
+    // Returns node x (already unlinked from the tree) to the free list.
+    // x may be the root of a whole detached subtree: its descendants are not walked here,
+    // they are handed back one level at a time as new_node reuses their ancestors.
+    void free_node(Index x) {
+        if (!x) return;
+        pool->free_nodes.push_back(x);
+    }
 
-// Build tree recursively from a segment of the input array
-// arr is 0-indexed. l_idx, r_idx are indices into arr.
-// Returns the ID of the root of the built subtree.
-int build_recursive(const vector<int>& arr, int l_idx, int r_idx, int parent_node) {
-    if (l_idx > r_idx) return 0;
-    int mid_idx = l_idx + (r_idx - l_idx) / 2;
-    int curr_node = new_node(arr[mid_idx], parent_node);
-    
-    tree[curr_node].ch[0] = build_recursive(arr, l_idx, mid_idx - 1, curr_node);
-    tree[curr_node].ch[1] = build_recursive(arr, mid_idx + 1, r_idx, curr_node);
-    
-    push_up(curr_node);
-    return curr_node;
-}
+    // Gives this sequence's nodes back to a shared pool and leaves the sequence empty.
+    // A pool no other instance uses is emptied outright: all its IDs become fresh again.
+    void release() {
+        if (pool->instances > 1) {
+            free_node(root);
+        } else {
+            pool->tot_nodes = 0;
+            pool->free_nodes.clear();
+        }
+        root = 0;
+    }
+
+    /**
+     * @brief Pre-sizes the node arena so that a sequence of `n` elements can be held
+     * without further allocation. The arena otherwise grows on demand.
+     *
+     * @param n The number of sequence elements to make room for.
+     */
+    void reserve(Index n) {
+        pool->tree.reserve((size_t)n + 1); // Plus the null sentinel
+    }
+
+    // Build tree recursively from a segment of the input array
+    // arr is 0-indexed. l_idx, r_idx are indices into arr.
+    // Returns the ID of the root of the built subtree.
+    Index build_recursive(const vector<key_type>& arr, Index l_idx, Index r_idx, Index parent_node) {
+        if (l_idx > r_idx) return 0;
+        Index mid_idx = l_idx + (r_idx - l_idx) / 2;
+        Index curr_node = new_node(arr[mid_idx], parent_node);
+
+        // The children are built before taking links(curr_node): building may grow the arena.
+        Index left = build_recursive(arr, l_idx, mid_idx - 1, curr_node);
+        Index right = build_recursive(arr, mid_idx + 1, r_idx, curr_node);
+        links(curr_node).ch[0] = left;
+        links(curr_node).ch[1] = right;
+
+        push_up(curr_node);
+        return curr_node;
+    }
+
+    // Runs body(t) for every t in [begin, end), split into contiguous slices over
+    // num_threads threads when the range is large enough to be worth it.
+    template <class Body>
+    static void parallel_for(Index begin, Index end, int num_threads, Body body) {
+        const long long MIN_PER_THREAD = 1 << 15;
+        long long count = end - begin;
+        int threads = (int)min((long long)num_threads, count / MIN_PER_THREAD);
+        if (threads <= 1) {
+            for (Index t = begin; t < end; ++t) body(t);
+            return;
+        }
+        vector<thread> workers;
+        for (int w = 0; w < threads; ++w) {
+            Index lo = begin + (Index)(count * w / threads);
+            Index hi = begin + (Index)(count * (w + 1) / threads);
+            workers.emplace_back([=]() {
+                for (Index t = lo; t < hi; ++t) body(t);
+            });
+        }
+        for (thread& worker : workers) worker.join();
+    }
+
+    // Builds a balanced subtree holding arr without recursion and returns its root.
+    // Element i gets node ID first + i, so nodes are laid out in sequence order and every
+    // subtree occupies a contiguous block of IDs. With j = i + 1, node j has height equal to
+    // the number of trailing zero bits of j; its children are j -/+ lowbit(j) / 2, where a
+    // right child past the end is replaced by its own left child until it fits.
+    // Levels are linked bottom-up; nodes within a level are independent, so each level
+    // (and the initialization pass) can be split across num_threads threads.
+    Index build_iterative(const vector<key_type>& arr, int num_threads) {
+        if (arr.empty()) return 0;
+        Index first = claim_fresh_ids(arr.size());
+        Index n = (Index)arr.size();
+        auto id = [first](Index j) -> Index { return j ? first + j - 1 : 0; };
+
+        parallel_for(0, n, num_threads, [&](Index i) {
+            Links& lx = links(first + i);
+            Payload& px = payload(first + i);
+            lx.pa = 0;
+            lx.ch[0] = lx.ch[1] = 0;
+            lx.sz = 1;
+            lx.rev = false;
+            lx.tagged = false;
+            px.key = arr[i];
+            px.agg = Policy::lift(arr[i]);
+            px.lazy = Policy::lazy_identity();
+        });
+
+        // Level arithmetic is done in long long: j + low / 2 may not fit in a narrow Index.
+        long long top = 1;
+        for (long long low = 2; low <= n; low <<= 1) {
+            top = low;
+            // Nodes of this level: j = low * (2t + 1)
+            parallel_for(0, (Index)((n / low + 1) / 2), num_threads, [&, low](Index t) {
+                long long j = low * (2 * t + 1);
+                long long left = j - low / 2;
+                long long right = j + low / 2;
+                while (right > n && (right & -right) > 1) right -= (right & -right) / 2;
+                if (right > n) right = 0;
+
+                Index x = id((Index)j);
+                links(x).ch[0] = id((Index)left);
+                links(x).ch[1] = id((Index)right);
+                links(id((Index)left)).pa = x;
+                if (right) links(id((Index)right)).pa = x;
+                push_up(x);
+            });
+        }
+        return id((Index)top);
+    }
+
+    // Finds the k-th node in the splay tree (1-indexed in-order rank: a[i] is at rank i + 1)
+    // Does NOT splay the found node; caller is responsible for splaying if needed.
+    Index find_kth(Index k_rank) {
+        Index curr = root;
+        if (k_rank < 1 || k_rank > links(root).sz) return 0; 
+
+        while (true) {
+            push_down(curr);
+            Index left_sz = links(links(curr).ch[0]).sz;
+            if (k_rank <= left_sz) {
+                curr = links(curr).ch[0];
+            } else if (k_rank == left_sz + 1) {
+                return curr;
+            } else {
+                k_rank -= (left_sz + 1);
+                curr = links(curr).ch[1];
+            }
+        }
+    }
 
-// Finds the k-th node in the splay tree (1-indexed based on current tree structure including dummies)
-// Does NOT splay the found node; caller is responsible for splaying if needed.
-int find_kth(int k_rank) {
-    int curr = root;
-    if (k_rank < 1 || k_rank > tree[root].sz) return 0; 
-
-    while (true) {
-        push_down(curr);
-        int left_sz = tree[tree[curr].ch[0]].sz;
-        if (k_rank <= left_sz) {
-            curr = tree[curr].ch[0];
-        } else if (k_rank == left_sz + 1) {
-            return curr;
+    // Top-down splay: makes the k-th node (1-indexed) of the subtree rooted at t the root
+    // of that subtree in a single pass, restructuring on the way down instead of
+    // descending with find_kth and climbing back with splay. Returns the new subtree root;
+    // the caller must link it to t's former parent (its pa is left untouched).
+    // Nodes passed on the way are hung on a left tree (right spine) and a right tree
+    // (left spine), which become the children of the found node at the end.
+    Index splay_kth_top_down(Index t, Index k_rank) {
+        Index left_root = 0, left_max = 0;   // Left tree and the bottom of its right spine
+        Index right_root = 0, right_min = 0; // Right tree and the bottom of its left spine
+        Index x = t;
+        Index x_pa = links(t).pa;
+
+        while (true) {
+            push_down(x);
+            Index left_sz = links(links(x).ch[0]).sz;
+            if (k_rank <= left_sz) {
+                Index y = links(x).ch[0];
+                push_down(y);
+                if (k_rank <= links(links(y).ch[0]).sz) { // Zig-Zig: rotate y above x
+                    links(x).ch[0] = links(y).ch[1];
+                    if (links(y).ch[1]) links(links(y).ch[1]).pa = x;
+                    links(y).ch[1] = x;
+                    links(x).pa = y;
+                    push_up(x);
+                    x = y;
+                }
+                // Link x (and its right subtree) into the right tree
+                if (right_min) links(right_min).ch[0] = x;
+                else right_root = x;
+                links(x).pa = right_min;
+                right_min = x;
+                x = links(x).ch[0];
+            } else if (k_rank == left_sz + 1) {
+                break;
+            } else {
+                Index y = links(x).ch[1];
+                push_down(y);
+                if (k_rank - left_sz - 1 > links(links(y).ch[0]).sz + 1) { // Zag-Zag: rotate y above x
+                    links(x).ch[1] = links(y).ch[0];
+                    if (links(y).ch[0]) links(links(y).ch[0]).pa = x;
+                    links(y).ch[0] = x;
+                    links(x).pa = y;
+                    push_up(x);
+                    x = y;
+                }
+                // Link x (and its left subtree) into the left tree
+                if (left_max) links(left_max).ch[1] = x;
+                else left_root = x;
+                links(x).pa = left_max;
+                left_max = x;
+                k_rank -= links(links(x).ch[0]).sz + 1;
+                x = links(x).ch[1];
+            }
+        }
+
+        // Reassemble: x's children go to the open ends of the spines, the trees become x's children
+        if (left_max) {
+            links(left_max).ch[1] = links(x).ch[0];
+            if (links(x).ch[0]) links(links(x).ch[0]).pa = left_max;
+            links(x).ch[0] = left_root;
+            links(left_root).pa = x;
+        }
+        if (right_min) {
+            links(right_min).ch[0] = links(x).ch[1];
+            if (links(x).ch[1]) links(links(x).ch[1]).pa = right_min;
+            links(x).ch[1] = right_root;
+            links(right_root).pa = x;
+        }
+        // Spine nodes lost or gained children: fix them bottom-up by following pa
+        for (Index y = left_max; y && y != x; y = links(y).pa) push_up(y);
+        for (Index y = right_min; y && y != x; y = links(y).pa) push_up(y);
+        push_up(x);
+        links(x).pa = x_pa;
+        return x;
+    }
+
+    // Splays the node of tree rank left_rank to the root and the node of tree rank
+    // right_rank (> left_rank) to the root's right child, using top-down splays.
+    // Returns the node at right_rank; the nodes strictly between the two ranks form
+    // its left subtree.
+    Index splay_boundaries(Index left_rank, Index right_rank) {
+        root = splay_kth_top_down(root, left_rank);
+
+        right_rank -= links(links(root).ch[0]).sz + 1;
+        Index right_boundary_node = splay_kth_top_down(links(root).ch[1], right_rank);
+        links(root).ch[1] = right_boundary_node;
+        push_up(root);
+
+        return right_boundary_node;
+    }
+
+    // Same as splay_boundaries, using find_kth and bottom-up splays.
+    // Kept as the reference the top-down path is benchmarked against.
+    Index splay_boundaries_bottom_up(Index left_rank, Index right_rank) {
+        Index left_boundary_node = find_kth(left_rank);
+        splay(left_boundary_node, 0);
+
+        Index right_boundary_node = find_kth(right_rank);
+        splay(right_boundary_node, root);
+
+        return right_boundary_node;
+    }
+
+    // Helper to isolate the subtree for a non-empty original 0-indexed range [l_orig, r_orig].
+    // Returns the ID of the root of a subtree holding exactly that range.
+    // Tree ranks are 1-indexed, so a[i] is at tree rank i + 1 and the range lies between
+    // the node at rank l_orig (before it) and the node at rank r_orig + 2 (after it).
+    // A boundary that would fall off an edge of the sequence is not needed: prefix and
+    // suffix ranges cost one splay and the whole sequence none.
+    Index get_interval_subtree_root(Index l_orig, Index r_orig) {
+        bool has_left = l_orig > 0;
+        bool has_right = r_orig < links(root).sz - 1;
+
+        if (has_left && has_right) {
+            Index right_boundary_node = splay_boundaries(l_orig, r_orig + 2);
+            return links(right_boundary_node).ch[0];
+        }
+        if (has_left) {
+            root = splay_kth_top_down(root, l_orig);
+            return links(root).ch[1];
+        }
+        if (has_right) {
+            root = splay_kth_top_down(root, r_orig + 2);
+            return links(root).ch[0];
+        }
+        return root;
+    }
+
+    // Unlinks the subtree holding the original 0-indexed range [l_orig, r_orig] and
+    // returns its root (with pa cleared). The remaining tree stays consistent.
+    Index detach_range(Index l_orig, Index r_orig) {
+        Index subtree_r = get_interval_subtree_root(l_orig, r_orig);
+        Index parent = links(subtree_r).pa;
+        if (!parent) { // The whole sequence
+            root = 0;
+            return subtree_r;
+        }
+
+        links(parent).ch[get_child_type(subtree_r)] = 0;
+        links(subtree_r).pa = 0;
+
+        push_up(parent);
+        push_up(root);
+        return subtree_r;
+    }
+
+    // Links the detached subtree rooted at sub so that its elements start at
+    // original 0-indexed position pos. pos may equal the current sequence length.
+    // At either edge of the sequence only the first or last node is splayed.
+    void attach_subtree_at(Index pos, Index sub) {
+        Index n = links(root).sz;
+        Index parent;
+        int side;
+        if (n == 0) {
+            root = sub;
+            links(sub).pa = 0;
+            return;
+        } else if (pos == 0) { // Left child of the first node
+            root = parent = splay_kth_top_down(root, 1);
+            side = 0;
+        } else if (pos == n) { // Right child of the last node
+            root = parent = splay_kth_top_down(root, n);
+            side = 1;
+        } else { // Left child of the node after the gap, below the node before it
+            parent = splay_boundaries(pos, pos + 1);
+            side = 0;
+        }
+
+        links(parent).ch[side] = sub;
+        links(sub).pa = parent;
+
+        push_up(parent);
+        push_up(root);
+    }
+
+
+    /**
+     * @brief Builds the splay tree from an initial sequence of elements.
+     * Clears any existing tree structure. A pool owned by this instance alone is reset;
+     * in a shared pool the old nodes go back to the free list.
+     * The build is iterative and lays the nodes out in sequence order, unless the pool has
+     * freed nodes: those are reused first, so rebuilding on a shared pool does not grow it.
+     *
+     * @note Time Complexity: O(N), Space Complexity: O(N) where N is the size of the initial sequence.
+     *
+     * @param initial_sequence The sequence of elements to build the tree from.
+     * @param num_threads Number of threads to build with; large inputs are split across them.
+     */
+    void build_from_sequence(const vector<key_type>& initial_sequence, int num_threads = 1) {
+        release();
+        // Tree[0] is a sentinel/null node, its size should always be 0.
+        links(0).sz = 0; payload(0).agg = Policy::identity(); payload(0).key = key_type(); payload(0).lazy = Policy::lazy_identity();
+
+        if (pool->free_nodes.empty()) {
+            root = build_iterative(initial_sequence, num_threads);
         } else {
-            k_rank -= (left_sz + 1);
-            curr = tree[curr].ch[1];
+            root = build_recursive(initial_sequence, 0, (Index)initial_sequence.size() - 1, 0);
         }
     }
-}
 
-// Helper to isolate the subtree for an original 0-indexed range [l_orig, r_orig].
-// It splays nodes such that the root of the desired subtree is tree[tree[root].ch[1]].ch[0].
-// Returns the ID of this subtree root.
-// Tree ranks for boundaries:
-// Node before a[l_orig] (i.e., a[l_orig-1] or DUMMY_MIN) is at tree rank l_orig + 1.
-// Node after  a[r_orig] (i.e., a[r_orig+1] or DUMMY_MAX) is at tree rank r_orig + 3.
-int get_interval_subtree_root(int l_orig, int r_orig) {
-    int left_boundary_node = find_kth(l_orig + 1); 
-    splay(left_boundary_node, 0);
 
-    int right_boundary_node = find_kth(r_orig + 3); 
-    splay(right_boundary_node, root);
+    /**
+     * @brief Inserts a new element with value `val` at 0-indexed `pos` in the sequence.
+     *
+     * @param pos The 0-indexed position where the element should be inserted.
+     * @param val The value of the element to insert.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    void insert_at_position(Index pos, const key_type& val) {
+        attach_subtree_at(pos, new_node(val, 0));
+    }
 
-    return tree[right_boundary_node].ch[0]; 
-}
+    /**
+     * @brief Inserts the elements of `values` starting at 0-indexed `pos` in the sequence.
+     * The batch is built as a perfectly balanced subtree and spliced in one step.
+     *
+     * @param pos The 0-indexed position where the first new element should be placed.
+     * @param values The elements to insert, in order.
+     *
+     * @note Time Complexity: O(K + log N) amortized, where K is values.size().
+     */
+    void insert_sequence_at(Index pos, const vector<key_type>& values) {
+        if (values.empty()) return;
+        Index sub = build_recursive(values, 0, (Index)values.size() - 1, 0);
+        attach_subtree_at(pos, sub);
+    }
 
+    /**
+     * @brief Deletes the element at 0-indexed `pos` from the sequence.
+     *
+     * @param pos The 0-indexed position of the element to delete.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    void delete_at_position(Index pos) {
+        delete_range(pos, pos);
+    }
 
-/**
- * @brief Builds the splay tree from an initial sequence of integers.
- * Clears any existing tree structure.
- * The sequence is represented by nodes between two dummy nodes.
- *
- * @note Time Complexity: O(N), Space Complexity: O(N) where N is the size of the initial sequence.
- *
- * @param initial_sequence The sequence of integers to build the tree from.
- */
-void build_from_sequence(const vector<int>& initial_sequence) {
-    tot_nodes = 0;
-    // Tree[0] is a sentinel/null node, its size should always be 0.
-    tree[0].sz = 0; tree[0].sum = 0; tree[0].key = 0; tree[0].lazy = 0;
-
-    // Dummy node at the beginning (tree rank 1)
-    root = new_node(0, 0); 
-    
-    // Dummy node at the end (tree rank N+2, where N is initial_sequence.size())
-    tree[root].ch[1] = new_node(0, root); 
+    /**
+     * @brief Deletes the elements in the sequence range [l, r] (0-indexed).
+     * The whole range is detached as one subtree and handed to the node allocator,
+     * which reclaims its nodes incrementally on later insertions.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     *
+     * @note Time Complexity: O(log N) amortized, independent of r - l.
+     */
+    void delete_range(Index l, Index r) {
+        if (l > r) return;
+        free_node(detach_range(l, r));
+    }
 
-    int actual_data_root = build_recursive(initial_sequence, 0, 
-                                           initial_sequence.empty() ? -1 : (int)initial_sequence.size() - 1, 
-                                           tree[root].ch[1]);
-    tree[tree[root].ch[1]].ch[0] = actual_data_root;
+    /**
+     * @brief Moves the elements in the sequence range [l, r] (0-indexed) so that they start
+     * at position `dest` of the resulting sequence, keeping their order.
+     * The range is cut out as one subtree and re-attached, so no nodes are copied.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @param dest The 0-indexed position of the first moved element after the move
+     *             (0 <= dest <= size - (r - l + 1)).
+     *
+     * @note Time Complexity: O(log N) amortized, independent of r - l.
+     */
+    void move_range(Index l, Index r, Index dest) {
+        if (l > r || l == dest) return;
+        attach_subtree_at(dest, detach_range(l, r));
+    }
 
-    push_up(tree[root].ch[1]);
-    push_up(root);
-}
+    /**
+     * @brief Cyclically rotates the sequence range [l, r] (0-indexed) to the right by `k`:
+     * the last k elements of the range move to its front, keeping their order.
+     * Negative k rotates to the left.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @param k The number of positions to rotate by.
+     *
+     * @note Time Complexity: O(log N) amortized, independent of k and r - l.
+     */
+    void rotate_range(Index l, Index r, Index k) {
+        if (l >= r) return;
+        Index len = r - l + 1;
+        k %= len;
+        if (k < 0) k += len;
+        if (k == 0) return;
+        move_range(r - k + 1, r, l);
+    }
 
+    // --- Split / Join ---
+    // Sequences on the same pool exchange elements by relinking subtrees, so split and
+    // join never copy nodes.
+
+    /**
+     * @brief Returns the number of elements in the sequence.
+     */
+    Index sequence_size() {
+        return links(root).sz;
+    }
+
+    /**
+     * @brief Splits the sequence before 0-indexed `pos`.
+     * This sequence keeps [0, pos) and [pos, size) is returned as a new instance on the same pool.
+     *
+     * @param pos The 0-indexed position of the first element to split off (0 <= pos <= size).
+     * @return The suffix, empty if pos == size.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    SplayTree split(Index pos) {
+        SplayTree suffix(pool);
+        Index n = sequence_size();
+        if (pos < n) suffix.root = detach_range(pos, n - 1);
+        return suffix;
+    }
 
-/**
- * @brief Inserts a new element with value `val` at 0-indexed `pos` in the sequence.
- *
- * @param pos The 0-indexed position where the element should be inserted.
- * @param val The value of the element to insert.
- *
- * @note Time Complexity: O(log N) amortized.
- */
-void insert_at_position(int pos, int val) {
-    int prev_node = find_kth(pos + 1); // Node that will be before the new value
-    splay(prev_node, 0);
+    /**
+     * @brief Appends the elements of `other` to the end of this sequence and leaves `other` empty.
+     * Nodes are relinked if `other` shares this pool and copied over otherwise.
+     *
+     * @param other Another sequence of the same type.
+     *
+     * @note Time Complexity: O(log N) amortized on a shared pool, O(M + log N) otherwise,
+     *       where M is the size of `other`.
+     */
+    void join(SplayTree& other) {
+        if (&other == this || !other.root) return;
+        if (other.pool == pool) {
+            attach_subtree_at(sequence_size(), other.root);
+            other.root = 0;
+            return;
+        }
+        vector<key_type> values;
+        other.flatten_range(0, other.sequence_size() - 1, values);
+        insert_sequence_at(sequence_size(), values);
+        other.release();
+    }
 
-    int next_node = find_kth(pos + 2); // Node that will be after the new value
-    splay(next_node, root);
+    // --- Compaction ---
+
+    // Appends the nodes of the subtree rooted at x to order level by level.
+    void collect_bfs(Index x, vector<Index>& order) {
+        size_t head = order.size();
+        order.push_back(x);
+        while (head < order.size()) {
+            Index y = order[head++];
+            push_down(y);
+            if (links(y).ch[0]) order.push_back(links(y).ch[0]);
+            if (links(y).ch[1]) order.push_back(links(y).ch[1]);
+        }
+    }
 
-    int new_val_node = new_node(val, next_node);
-    tree[next_node].ch[0] = new_val_node;
+    // Appends to order the nodes of the subtree rooted at x that are less than `height`
+    // levels below it, in van Emde Boas order: the top half of the levels first, then each
+    // subtree hanging below it. The roots of the subtrees below those levels go to frontier.
+    void collect_veb(Index x, Index height, vector<Index>& order, vector<Index>& frontier) {
+        if (height == 1) {
+            push_down(x);
+            order.push_back(x);
+            if (links(x).ch[0]) frontier.push_back(links(x).ch[0]);
+            if (links(x).ch[1]) frontier.push_back(links(x).ch[1]);
+            return;
+        }
+        Index top = height / 2;
+        vector<Index> middle;
+        collect_veb(x, top, order, middle);
+        for (Index y : middle) collect_veb(y, height - top, order, frontier);
+    }
 
-    push_up(next_node);
-    push_up(root);
-}
+    // Returns the number of levels in the subtree rooted at x (0 if x is 0).
+    Index subtree_height(Index x) {
+        if (!x) return 0;
+        Index height = 0;
+        vector<Index> level = {x}, next;
+        while (!level.empty()) {
+            ++height;
+            next.clear();
+            for (Index y : level) {
+                if (links(y).ch[0]) next.push_back(links(y).ch[0]);
+                if (links(y).ch[1]) next.push_back(links(y).ch[1]);
+            }
+            swap(level, next);
+        }
+        return height;
+    }
 
-/**
- * @brief Deletes the element at 0-indexed `pos` from the sequence.
- *
- * @param pos The 0-indexed position of the element to delete.
- *
- * @note Time Complexity: O(log N) amortized.
- */
-void delete_at_position(int pos) {
-    int prev_node = find_kth(pos + 1); // Node before the one to delete
-    splay(prev_node, 0);
+    /**
+     * @brief Renumbers the live nodes 1..K in the given order and moves them into a freshly
+     * sized arena. Deleted nodes and the free list are dropped, and the arena shrinks to the
+     * chunks the live nodes need. Pending lazy tags are pushed down on the way.
+     * Restores locality for descents after many rotations; meant for quiet periods.
+     * Node IDs change, so every other sequence on the pool must be passed in to be
+     * renumbered with it; compacting without all of them aborts.
+     *
+     * @param sharing The other sequences allocated from this pool.
+     * @param order BFS_ORDER or VEB_ORDER.
+     *
+     * @note Time Complexity: O(K log H) where K is the number of live nodes and H the
+     *       tree height. Space Complexity: O(K); old and new arenas coexist while copying.
+     */
+    void compact(const vector<SplayTree*>& sharing, NodeOrder order = BFS_ORDER) {
+        if (pool->instances != sharing.size() + 1) {
+            cerr << "splay tree: compact() needs every sequence that shares the pool" << endl;
+            abort();
+        }
+        vector<SplayTree*> owners = {this};
+        owners.insert(owners.end(), sharing.begin(), sharing.end());
+
+        vector<Index> old_ids; // Live nodes in their new order
+        for (SplayTree* owner : owners) {
+            Index r = owner->root;
+            if (!r) continue;
+            if (order == BFS_ORDER) {
+                collect_bfs(r, old_ids);
+            } else {
+                vector<Index> frontier;
+                collect_veb(r, subtree_height(r), old_ids, frontier);
+            }
+        }
 
-    int next_node = find_kth(pos + 3); // Node after the one to delete
-    splay(next_node, root);
+        vector<Index> new_id((size_t)pool->tot_nodes + 1, 0);
+        for (size_t i = 0; i < old_ids.size(); ++i) new_id[old_ids[i]] = (Index)(i + 1);
+
+        Storage compacted;
+        compacted.reserve(old_ids.size() + 1);
+        for (size_t i = 0; i < old_ids.size(); ++i) {
+            Links& lx = compacted.links(i + 1);
+            lx = links(old_ids[i]);
+            lx.pa = new_id[lx.pa];
+            lx.ch[0] = new_id[lx.ch[0]];
+            lx.ch[1] = new_id[lx.ch[1]];
+            compacted.payload(i + 1) = payload(old_ids[i]);
+        }
+        pool->tree = move(compacted);
 
-    tree[next_node].ch[0] = 0;
+        for (SplayTree* owner : owners) owner->root = new_id[owner->root];
+        pool->tot_nodes = (Index)old_ids.size();
+        pool->free_nodes.clear();
+        pool->free_nodes.shrink_to_fit();
+    }
 
-    push_up(next_node);
-    push_up(root);
-}
+    /**
+     * @brief Compacts a pool used by this sequence alone (see above).
+     *
+     * @param order BFS_ORDER or VEB_ORDER.
+     */
+    void compact(NodeOrder order = BFS_ORDER) {
+        compact({}, order);
+    }
 
 
-/**
- * @brief Updates the values of elements in the sequence range [l, r] (0-indexed) by adding `val_to_add`.
- * This is a range update operation using lazy propagation.
- *
- * @param l The 0-indexed start of the range (inclusive).
- * @param r The 0-indexed end of the range (inclusive).
- * @param val_to_add The value to add to each element in the range.
- *
- * @note Time Complexity: O(log N) amortized.
- */
-void update_range(int l, int r, int val_to_add) {
-    if (l > r) return;
-    int subtree_r = get_interval_subtree_root(l, r);
-    apply_lazy_value(subtree_r, val_to_add);
-    
-    push_up(tree[subtree_r].pa); 
-    push_up(tree[tree[subtree_r].pa].pa); 
-}
+    /**
+     * @brief Applies the lazy action `f` to every element in the sequence range [l, r] (0-indexed).
+     * This is a range update operation using lazy propagation.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @param f The action to apply, as defined by the policy.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    void apply_range(Index l, Index r, const lazy_type& f) {
+        if (l > r) return;
+        Index subtree_r = get_interval_subtree_root(l, r);
+        apply_lazy_value(subtree_r, f);
+
+        push_up(links(subtree_r).pa);
+        push_up(links(links(subtree_r).pa).pa);
+    }
+
+    /**
+     * @brief Updates the values of elements in the sequence range [l, r] (0-indexed) by adding `val_to_add`.
+     * Requires a policy providing add_action().
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @param val_to_add The value to add to each element in the range.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    void update_range(Index l, Index r, const key_type& val_to_add) {
+        apply_range(l, r, Policy::add_action(val_to_add));
+    }
+
+    /**
+     * @brief Replaces every element x in the sequence range [l, r] (0-indexed) by mul * x + add.
+     * Requires a policy providing affine_action().
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @param mul The factor to multiply each element by.
+     * @param add The value to add to each element after scaling.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    void affine_range(Index l, Index r, const key_type& mul, const key_type& add) {
+        apply_range(l, r, Policy::affine_action(mul, add));
+    }
+
+    /**
+     * @brief Sets every element in the sequence range [l, r] (0-indexed) to `val`.
+     * Requires a policy providing affine_action().
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @param val The value to assign to each element in the range.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    void assign_range(Index l, Index r, const key_type& val) {
+        apply_range(l, r, Policy::affine_action(key_type(0), val));
+    }
+
+    /**
+     * @brief Reverses the order of the elements in the sequence range [l, r] (0-indexed).
+     * This is a range update operation using a lazy reversal tag.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    void reverse_range(Index l, Index r) {
+        if (l >= r) return;
+        Index subtree_r = get_interval_subtree_root(l, r);
+        apply_reverse(subtree_r);
+
+        push_up(links(subtree_r).pa);
+        push_up(links(links(subtree_r).pa).pa);
+    }
+
+    /**
+     * @brief Queries the aggregate of the elements in the sequence range [l, r] (0-indexed).
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @return The aggregate of the specified range. Returns the policy identity for an empty range (l > r).
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    agg_type query_range(Index l, Index r) {
+        if (l > r) return Policy::identity();
+        Index subtree_r = get_interval_subtree_root(l, r);
+        return payload(subtree_r).agg;
+    }
+
+    /**
+     * @brief Queries the sum of elements in the sequence range [l, r] (0-indexed).
+     * Requires a policy whose aggregate has a `sum` field.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @return The sum of elements in the specified range. Returns 0 for an empty range (l > r).
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    auto query_sum_range(Index l, Index r) {
+        return query_range(l, r).sum;
+    }
+
+    // --- Read-Only Queries ---
+    // These walk the tree from the root without push_down or rotations. Tags that have not
+    // been pushed down yet are folded into a (pending action, pending reversal) pair carried
+    // along the walk, and applied to copies of the keys and aggregates that are read.
+
+    // Aggregate of node x's subtree as seen from above, given what is pending over it.
+    agg_type read_agg(Index x, const lazy_type& pending, bool flipped) {
+        if (!x) return Policy::identity();
+        agg_type agg = payload(x).agg;
+        if (Policy::has_lazy(pending)) {
+            key_type key = payload(x).key;
+            Policy::apply(key, agg, links(x).sz, pending);
+        }
+        if (flipped) Policy::reverse(agg);
+        return agg;
+    }
+
+    // Value of node x's own element as seen from above.
+    key_type read_key(Index x, const lazy_type& pending) {
+        key_type key = payload(x).key;
+        if (Policy::has_lazy(pending)) {
+            agg_type agg = Policy::lift(key);
+            Policy::apply(key, agg, 1, pending);
+        }
+        return key;
+    }
+
+    // Aggregate of node x's own element as seen from above.
+    agg_type read_key_agg(Index x, const lazy_type& pending) {
+        key_type key = payload(x).key;
+        agg_type agg = Policy::lift(key);
+        if (Policy::has_lazy(pending)) Policy::apply(key, agg, 1, pending);
+        return agg;
+    }
+
+    // Moves a read-only walk from x to its logical child on `side` (0 = left, 1 = right),
+    // updating what is pending above the new node.
+    Index read_child(Index x, int side, lazy_type& pending, bool& flipped) {
+        Index child = links(x).ch[side ^ (int)flipped];
+        lazy_type child_pending = payload(x).lazy;
+        Policy::compose(child_pending, pending); // x's own tag is older than the ones above it
+        pending = child_pending;
+        flipped = flipped != links(x).rev;
+        return child;
+    }
+
+    // Size of the logical left subtree of x.
+    Index read_left_size(Index x, bool flipped) {
+        return links(links(x).ch[(int)flipped]).sz;
+    }
+
+    /**
+     * @brief Queries the aggregate of the sequence range [l, r] (0-indexed) without
+     * modifying the tree: no splaying, no rotations and no push_down writes, so several
+     * read-only queries may run concurrently while no update is in progress.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @return The aggregate of the specified range. Returns the policy identity for an empty range (l > r).
+     *
+     * @note Time Complexity: O(D), where D is the current depth of the tree. As the tree
+     *       is not restructured, this is not amortized; it is O(log N) when the tree is
+     *       balanced, e.g. right after build_from_sequence or a run of splaying operations
+     *       on random positions.
+     */
+    agg_type query_range_readonly(Index l, Index r) {
+        if (l > r) return Policy::identity();
+        Index lo = l + 1, hi = r + 1; // 1-indexed tree ranks
+        Index x = root;
+        lazy_type pending = Policy::lazy_identity();
+        bool flipped = false;
+
+        // Find the highest node inside the range: the range splits around it
+        while (true) {
+            Index left_sz = read_left_size(x, flipped);
+            if (hi <= left_sz) {
+                x = read_child(x, 0, pending, flipped);
+            } else if (lo > left_sz + 1) {
+                lo -= left_sz + 1;
+                hi -= left_sz + 1;
+                x = read_child(x, 1, pending, flipped);
+            } else {
+                break;
+            }
+        }
+        agg_type res = read_key_agg(x, pending);
+        Index left_sz = read_left_size(x, flipped);
+
+        // Left part: logical ranks [lo, left_sz] of the left subtree, folded right to left
+        lazy_type y_pending = pending;
+        bool y_flipped = flipped;
+        Index y = read_child(x, 0, y_pending, y_flipped);
+        while (y) {
+            if (lo <= 1) {
+                res = Policy::combine(read_agg(y, y_pending, y_flipped), res);
+                break;
+            }
+            Index y_left_sz = read_left_size(y, y_flipped);
+            if (lo <= y_left_sz + 1) {
+                lazy_type c_pending = y_pending;
+                bool c_flipped = y_flipped;
+                Index right = read_child(y, 1, c_pending, c_flipped);
+                res = Policy::combine(Policy::combine(read_key_agg(y, y_pending),
+                                                      read_agg(right, c_pending, c_flipped)), res);
+                if (lo == y_left_sz + 1) break;
+                y = read_child(y, 0, y_pending, y_flipped);
+            } else {
+                lo -= y_left_sz + 1;
+                y = read_child(y, 1, y_pending, y_flipped);
+            }
+        }
+
+        // Right part: logical ranks [1, hi - left_sz - 1] of the right subtree, folded left to right
+        hi -= left_sz + 1;
+        y_pending = pending;
+        y_flipped = flipped;
+        y = read_child(x, 1, y_pending, y_flipped);
+        while (y && hi > 0) {
+            if (hi >= links(y).sz) {
+                res = Policy::combine(res, read_agg(y, y_pending, y_flipped));
+                break;
+            }
+            Index y_left_sz = read_left_size(y, y_flipped);
+            if (hi <= y_left_sz) {
+                y = read_child(y, 0, y_pending, y_flipped);
+            } else {
+                lazy_type c_pending = y_pending;
+                bool c_flipped = y_flipped;
+                Index left = read_child(y, 0, c_pending, c_flipped);
+                res = Policy::combine(res, Policy::combine(read_agg(left, c_pending, c_flipped),
+                                                           read_key_agg(y, y_pending)));
+                hi -= y_left_sz + 1;
+                y = read_child(y, 1, y_pending, y_flipped);
+            }
+        }
+        return res;
+    }
+
+    /**
+     * @brief Read-only version of query_sum_range; see query_range_readonly.
+     * Requires a policy whose aggregate has a `sum` field.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @return The sum of elements in the specified range. Returns 0 for an empty range (l > r).
+     *
+     * @note Time Complexity: O(D), where D is the current depth of the tree.
+     */
+    auto query_sum_range_readonly(Index l, Index r) {
+        return query_range_readonly(l, r).sum;
+    }
+
+    /**
+     * @brief Appends the elements of the sequence range [l, r] (0-indexed) to `out`, in order.
+     * The range is isolated once, then read by a single in-order traversal that folds
+     * pending lazy tags into the values it outputs without writing them back.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @param out The buffer to append to.
+     *
+     * @note Time Complexity: O(K + log N) amortized, where K is r - l + 1.
+     */
+    void flatten_range(Index l, Index r, vector<key_type>& out) {
+        if (l > r) return;
+        out.reserve(out.size() + (r - l + 1));
+
+        struct Frame {
+            Index x;
+            lazy_type pending;
+            bool flipped;
+        };
+        vector<Frame> stack;
+        Index x = get_interval_subtree_root(l, r);
+        lazy_type pending = Policy::lazy_identity();
+        bool flipped = false;
+        while (x || !stack.empty()) {
+            while (x) {
+                stack.push_back({x, pending, flipped});
+                x = read_child(x, 0, pending, flipped);
+            }
+            Frame top = stack.back();
+            stack.pop_back();
+            out.push_back(read_key(top.x, top.pending));
+            pending = top.pending;
+            flipped = top.flipped;
+            x = read_child(top.x, 1, pending, flipped);
+        }
+    }
+
+    /**
+     * @brief Queries the minimum element in the sequence range [l, r] (0-indexed).
+     * Requires a policy whose aggregate has a `mn` field.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @return The minimum in the specified range. Returns the identity's mn for an empty range (l > r).
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    key_type range_min(Index l, Index r) {
+        return query_range(l, r).mn;
+    }
 
-/**
- * @brief Queries the sum of elements in the sequence range [l, r] (0-indexed).
- *
- * @param l The 0-indexed start of the range (inclusive).
- * @param r The 0-indexed end of the range (inclusive).
- * @return The sum of elements in the specified range. Returns 0 for an empty range (l > r).
- *
- * @note Time Complexity: O(log N) amortized.
- */
-int query_sum_range(int l, int r) {
-    if (l > r) return 0;
-    int subtree_r = get_interval_subtree_root(l, r);
-    return tree[subtree_r].sum;
+    /**
+     * @brief Queries the maximum element in the sequence range [l, r] (0-indexed).
+     * Requires a policy whose aggregate has a `mx` field.
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @return The maximum in the specified range. Returns the identity's mx for an empty range (l > r).
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    key_type range_max(Index l, Index r) {
+        return query_range(l, r).mx;
+    }
+
+    // Returns the 0-indexed position of the leftmost element in [l_orig, r_orig] whose value
+    // equals the range minimum (find_max = 0) or maximum (find_max = 1).
+    // Descends from the isolated subtree root guided by mn/mx, then splays the found node.
+    Index find_extreme_position(Index l_orig, Index r_orig, int find_max) {
+        Index curr = get_interval_subtree_root(l_orig, r_orig);
+        key_type target = find_max ? payload(curr).agg.mx : payload(curr).agg.mn;
+        while (true) {
+            push_down(curr);
+            Index left = links(curr).ch[0];
+            if (left && (find_max ? payload(left).agg.mx : payload(left).agg.mn) == target) {
+                curr = left;
+            } else if (payload(curr).key == target) {
+                break;
+            } else {
+                curr = links(curr).ch[1];
+            }
+        }
+        splay(curr, 0);
+        return links(links(curr).ch[0]).sz;
+    }
+    /**
+     * @brief Finds the position of the minimum element in the sequence range [l, r] (0-indexed).
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @return The 0-indexed position of the leftmost minimum. Returns -1 for an empty range (l > r).
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    Index range_argmin(Index l, Index r) {
+        if (l > r) return -1;
+        return find_extreme_position(l, r, 0);
+    }
+
+    /**
+     * @brief Finds the position of the maximum element in the sequence range [l, r] (0-indexed).
+     *
+     * @param l The 0-indexed start of the range (inclusive).
+     * @param r The 0-indexed end of the range (inclusive).
+     * @return The 0-indexed position of the leftmost maximum. Returns -1 for an empty range (l > r).
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    Index range_argmax(Index l, Index r) {
+        if (l > r) return -1;
+        return find_extreme_position(l, r, 1);
+    }
+
+    /**
+     * @brief Finds how far a range starting at `l` can extend while `pred` holds on its aggregate.
+     * `pred` must be monotone (once false for a range, false for every longer one)
+     * and true for Policy::identity().
+     *
+     * @param l The 0-indexed start of the range (0 <= l <= size).
+     * @param pred Predicate on agg_type.
+     * @return The largest r such that pred holds on the aggregate of [l, r). Returns size
+     *         if pred holds on the whole suffix.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    template <class Pred>
+    Index max_right(Index l, Pred pred) {
+        Index n = sequence_size();
+        if (l >= n) return n;
+        Index curr = get_interval_subtree_root(l, n - 1);
+        if (pred(payload(curr).agg)) return n;
+
+        agg_type acc = Policy::identity();
+        Index pos = l;  // Position of the first element not yet folded into acc
+        Index last = curr;
+        while (curr) {
+            last = curr;
+            push_down(curr);
+            Index left = links(curr).ch[0];
+            agg_type with_left = Policy::combine(acc, payload(left).agg);
+            if (!pred(with_left)) {
+                curr = left;
+                continue;
+            }
+            agg_type with_key = Policy::combine(with_left, Policy::lift(payload(curr).key));
+            pos += links(left).sz;
+            if (!pred(with_key)) break;
+            acc = with_key;
+            pos++;
+            curr = links(curr).ch[1];
+        }
+        splay(last, 0);
+        return pos;
+    }
+
+    /**
+     * @brief Finds how far a range ending before `r` can extend to the left while `pred`
+     * holds on its aggregate. `pred` must be monotone and true for Policy::identity().
+     *
+     * @param r The 0-indexed end of the range (exclusive, 0 <= r <= size).
+     * @param pred Predicate on agg_type.
+     * @return The smallest l such that pred holds on the aggregate of [l, r). Returns 0
+     *         if pred holds on the whole prefix.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    template <class Pred>
+    Index min_left(Index r, Pred pred) {
+        if (r <= 0) return 0;
+        Index curr = get_interval_subtree_root(0, r - 1);
+        if (pred(payload(curr).agg)) return 0;
+
+        agg_type acc = Policy::identity();
+        Index pos = r;  // Elements from pos onwards are folded into acc
+        Index last = curr;
+        while (curr) {
+            last = curr;
+            push_down(curr);
+            Index right = links(curr).ch[1];
+            agg_type with_right = Policy::combine(payload(right).agg, acc);
+            if (!pred(with_right)) {
+                curr = right;
+                continue;
+            }
+            agg_type with_key = Policy::combine(Policy::lift(payload(curr).key), with_right);
+            pos -= links(right).sz;
+            if (!pred(with_key)) break;
+            acc = with_key;
+            pos--;
+            curr = links(curr).ch[0];
+        }
+        splay(last, 0);
+        return pos;
+    }
+
+    /**
+     * @brief Finds the first position whose prefix sum reaches `target`.
+     * All elements must be non-negative. Requires a policy whose aggregate has a `sum` field.
+     *
+     * @param target The threshold for the prefix sum.
+     * @return The smallest 0-indexed p such that the sum of [0, p] is at least `target`,
+     *         or size if the whole sequence sums to less than `target`.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    template <class Sum>
+    Index lower_bound_prefix_sum(const Sum& target) {
+        return max_right(0, [&](const agg_type& a) { return a.sum < target; });
+    }
+
+    // --- Ordered-Key Mode ---
+    // These operations treat the sequence as a sorted multiset of keys. They are valid as
+    // long as the sequence is only modified in order-preserving ways (insert_key, erase_key,
+    // range deletions, and updates such as adding a constant to every element).
+
+    /**
+     * @brief Counts the elements smaller than `key`, i.e. the rank of `key` in the sorted sequence.
+     *
+     * @param key The key to compare against.
+     * @return The number of elements x with x < key.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    Index count_less(const key_type& key) {
+        Index n = sequence_size();
+        if (n == 0) return 0;
+        Index curr = get_interval_subtree_root(0, n - 1);
+        Index cnt = 0;
+        Index last = curr;
+        while (curr) {
+            last = curr;
+            push_down(curr);
+            if (payload(curr).key < key) {
+                cnt += links(links(curr).ch[0]).sz + 1;
+                curr = links(curr).ch[1];
+            } else {
+                curr = links(curr).ch[0];
+            }
+        }
+        splay(last, 0);
+        return cnt;
+    }
+
+    /**
+     * @brief Finds the position of the first element not smaller than `key`.
+     *
+     * @param key The key to search for.
+     * @return The 0-indexed position of the first x with !(x < key), or size if there is none.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    Index lower_bound(const key_type& key) {
+        return count_less(key);
+    }
+
+    /**
+     * @brief Returns the k-th smallest element (0-indexed) of the sorted sequence.
+     * Like find_kth, an out-of-range k leaves the tree untouched and yields key_type().
+     *
+     * @param k The 0-indexed rank (0 <= k < size).
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    key_type kth_smallest(Index k) {
+        if (k < 0 || k >= sequence_size()) return key_type();
+        root = splay_kth_top_down(root, k + 1);
+        return payload(root).key;
+    }
+
+    /**
+     * @brief Inserts `key` into the sorted sequence, before any elements equal to it.
+     *
+     * @param key The key to insert.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    void insert_key(const key_type& key) {
+        insert_at_position(count_less(key), key);
+    }
+
+    /**
+     * @brief Removes one occurrence of `key` from the sorted sequence.
+     *
+     * @param key The key to remove.
+     * @return true if an element equal to `key` was found and removed.
+     *
+     * @note Time Complexity: O(log N) amortized.
+     */
+    bool erase_key(const key_type& key) {
+        Index pos = count_less(key);
+        if (pos >= sequence_size() || key < kth_smallest(pos)) return false;
+        delete_at_position(pos);
+        return true;
+    }
+};
+
+typedef SplayTree<SumMinMaxAffinePolicy<>> Seq;
+typedef SplayTree<SumAddPolicy<>> SumSeq;
+typedef SplayTree<PolyHashPolicy> HashSeq;
+
+// Builds `tree` and a reference Seq from `model`, applies the same edits to both and checks
+// that they end up with the same elements and range answers. Used to check that a layout,
+// index width or chunk allocator does not change what the tree computes.
+template <class Tree>
+void check_matches_reference(Tree& tree, const vector<int>& model) {
+    Seq reference;
+    reference.build_from_sequence(model);
+    tree.build_from_sequence(model);
+    int n = model.size();
+    auto edit = [n](auto& t) {
+        t.reverse_range(1, n * 2 / 3);
+        t.affine_range(0, n / 2, 3, -1);
+        t.move_range(n * 5 / 9, n - 1, 0);
+        t.delete_range(n / 4, n / 3);
+    };
+    edit(reference);
+    edit(tree);
+    int m = reference.sequence_size();
+    assert(tree.sequence_size() == m);
+    vector<int> expected, actual;
+    reference.flatten_range(0, m - 1, expected);
+    tree.flatten_range(0, m - 1, actual);
+    assert(actual == expected);
+    assert(tree.query_sum_range(1, m - 2) == reference.query_sum_range(1, m - 2));
+    assert(tree.range_argmin(0, m - 1) == reference.range_argmin(0, m - 1));
+    assert(tree.range_argmax(0, m - 1) == reference.range_argmax(0, m - 1));
 }
 
 void run_tests() {
     cout << "--- Running Splay Tree Tests ---" << endl;
     vector<int> model; 
+    Seq seq;
 
     // Test Case 1: Basic Build and Query
     cout << "\nTest Case 1: Basic Build and Query" << endl;
     model = {10, 20, 30, 40, 50};
-    build_from_sequence(model);
-    assert(query_sum_range(0, 4) == 150);
-    assert(query_sum_range(1, 3) == 90);
-    assert(query_sum_range(2, 2) == 30); 
-    assert(query_sum_range(2, 1) == 0);
+    seq.build_from_sequence(model);
+    assert(seq.query_sum_range(0, 4) == 150);
+    assert(seq.query_sum_range(1, 3) == 90);
+    assert(seq.query_sum_range(2, 2) == 30); 
+    assert(seq.query_sum_range(2, 1) == 0);
 
     // Test Case 2: Insertions
     cout << "\nTest Case 2: Insertions" << endl;
     model = {10, 20, 30};
-    build_from_sequence(model);
+    seq.build_from_sequence(model);
 
-    insert_at_position(1, 15);
-    assert(query_sum_range(0, 3) == 75);
-    assert(query_sum_range(1, 1) == 15);
+    seq.insert_at_position(1, 15);
+    assert(seq.query_sum_range(0, 3) == 75);
+    assert(seq.query_sum_range(1, 1) == 15);
 
-    insert_at_position(0, 5);
-    assert(query_sum_range(0, 4) == 80);
-    assert(query_sum_range(0, 0) == 5);
+    seq.insert_at_position(0, 5);
+    assert(seq.query_sum_range(0, 4) == 80);
+    assert(seq.query_sum_range(0, 0) == 5);
     
     model.push_back(40);
-    insert_at_position(5, 40); 
-    assert(query_sum_range(0, 5) == 120);
-    assert(query_sum_range(5, 5) == 40);
+    seq.insert_at_position(5, 40); 
+    assert(seq.query_sum_range(0, 5) == 120);
+    assert(seq.query_sum_range(5, 5) == 40);
 
     // Test Case 3: Deletions
     cout << "\nTest Case 3: Deletions" << endl;
     model = {10, 20, 30, 40, 50};
-    build_from_sequence(model);
+    seq.build_from_sequence(model);
 
-    delete_at_position(2);
-    assert(query_sum_range(0, 3) == 120);
-    assert(query_sum_range(1, 2) == 60);
+    seq.delete_at_position(2);
+    assert(seq.query_sum_range(0, 3) == 120);
+    assert(seq.query_sum_range(1, 2) == 60);
 
-    delete_at_position(0);
-    assert(query_sum_range(0, 2) == 110);
-    assert(query_sum_range(0, 0) == 20);
+    seq.delete_at_position(0);
+    assert(seq.query_sum_range(0, 2) == 110);
+    assert(seq.query_sum_range(0, 0) == 20);
 
-    delete_at_position(2); 
-    assert(query_sum_range(0, 1) == 60);
-    assert(query_sum_range(1, 1) == 40);
+    seq.delete_at_position(2); 
+    assert(seq.query_sum_range(0, 1) == 60);
+    assert(seq.query_sum_range(1, 1) == 40);
 
     // Test Case 4: Updates
     cout << "\nTest Case 4: Updates" << endl;
     model = {10, 20, 30, 40, 50};
-    build_from_sequence(model);
+    seq.build_from_sequence(model);
 
-    update_range(1, 3, 5);
-    assert(query_sum_range(0, 4) == 165);
+    seq.update_range(1, 3, 5);
+    assert(seq.query_sum_range(0, 4) == 165);
     
-    update_range(0, 4, -10);
-    assert(query_sum_range(0, 4) == 115);
+    seq.update_range(0, 4, -10);
+    assert(seq.query_sum_range(0, 4) == 115);
 
-    update_range(2, 2, 100);
-    assert(query_sum_range(2, 2) == 125);
-    assert(query_sum_range(0, 4) == 215);
+    seq.update_range(2, 2, 100);
+    assert(seq.query_sum_range(2, 2) == 125);
+    assert(seq.query_sum_range(0, 4) == 215);
 
     // Test Case 5: Mixed Operations & Empty Sequence
     cout << "\nTest Case 5: Mixed Operations & Empty Sequence" << endl;
     model.clear();
-    build_from_sequence(model); 
-    assert(query_sum_range(0, -1) == 0); 
+    seq.build_from_sequence(model); 
+    assert(seq.query_sum_range(0, -1) == 0); 
 
-    insert_at_position(0, 10);
-    assert(query_sum_range(0, 0) == 10);
+    seq.insert_at_position(0, 10);
+    assert(seq.query_sum_range(0, 0) == 10);
 
-    insert_at_position(1, 20);
-    assert(query_sum_range(0, 1) == 30);
+    seq.insert_at_position(1, 20);
+    assert(seq.query_sum_range(0, 1) == 30);
 
-    insert_at_position(0, 5);
-    assert(query_sum_range(0, 2) == 35);
+    seq.insert_at_position(0, 5);
+    assert(seq.query_sum_range(0, 2) == 35);
 
-    update_range(0, 1, 1);
-    assert(query_sum_range(0, 2) == 37);
+    seq.update_range(0, 1, 1);
+    assert(seq.query_sum_range(0, 2) == 37);
 
-    delete_at_position(1);
-    assert(query_sum_range(0, 1) == 26);
+    seq.delete_at_position(1);
+    assert(seq.query_sum_range(0, 1) == 26);
     
-    delete_at_position(1);
-    assert(query_sum_range(0, 0) == 6);
-
-    delete_at_position(0);
-    assert(query_sum_range(0, -1) == 0); 
-
-    insert_at_position(0, 100);
-    assert(query_sum_range(0, 0) == 100);
+    seq.delete_at_position(1);
+    assert(seq.query_sum_range(0, 0) == 6);
+
+    seq.delete_at_position(0);
+    assert(seq.query_sum_range(0, -1) == 0); 
+
+    seq.insert_at_position(0, 100);
+    assert(seq.query_sum_range(0, 0) == 100);
+
+    // Test Case 6: Node Recycling
+    cout << "\nTest Case 6: Node Recycling" << endl;
+    model = {1, 2, 3};
+    seq.build_from_sequence(model);
+    int nodes_after_build = seq.pool->tot_nodes;
+    for (int i = 0; i < 1000; ++i) {
+        seq.insert_at_position(1, i);
+        seq.delete_at_position(1);
+    }
+    assert(seq.pool->tot_nodes == nodes_after_build + 1);
+    assert(seq.query_sum_range(0, 2) == 6);
+    assert(seq.query_sum_range(1, 1) == 2);
+
+    // Test Case 7: Arena Growth Beyond One Chunk
+    cout << "\nTest Case 7: Arena Growth Beyond One Chunk" << endl;
+    model.assign(3 * CHUNK_SIZE, 1);
+    seq.reserve((int)model.size());
+    seq.build_from_sequence(model);
+    for (int i = 0; i < CHUNK_SIZE; ++i) seq.insert_at_position(i, 2);
+    assert(seq.pool->tree.capacity() >= 4 * CHUNK_SIZE + 1);
+    assert(seq.query_sum_range(0, 4 * CHUNK_SIZE - 1) == 5 * CHUNK_SIZE);
+    assert(seq.query_sum_range(CHUNK_SIZE - 1, CHUNK_SIZE) == 3);
+
+    // Test Case 8: Range Deletion
+    cout << "\nTest Case 8: Range Deletion" << endl;
+    model = {10, 20, 30, 40, 50, 60, 70};
+    seq.build_from_sequence(model);
+    seq.delete_range(2, 4); // 10, 20, 60, 70
+    assert(seq.query_sum_range(0, 3) == 160);
+    assert(seq.query_sum_range(2, 2) == 60);
+    seq.delete_range(3, 2);
+    assert(seq.query_sum_range(0, 3) == 160);
+    seq.delete_range(0, 3);
+    assert(seq.query_sum_range(0, -1) == 0);
+    nodes_after_build = seq.pool->tot_nodes;
+    for (int i = 0; i < 7; ++i) seq.insert_at_position(i, i + 1);
+    assert(seq.pool->tot_nodes == nodes_after_build); // All nodes came from the deleted ranges
+    assert(seq.query_sum_range(0, 6) == 28);
+    assert(seq.query_sum_range(3, 5) == 15);
+
+    // Test Case 9: Bulk Insertion
+    cout << "\nTest Case 9: Bulk Insertion" << endl;
+    model = {1, 2, 3};
+    seq.build_from_sequence(model);
+    seq.insert_sequence_at(1, {10, 20, 30, 40}); // 1, 10, 20, 30, 40, 2, 3
+    assert(seq.query_sum_range(0, 6) == 106);
+    assert(seq.query_sum_range(1, 4) == 100);
+    assert(seq.query_sum_range(5, 5) == 2);
+    seq.insert_sequence_at(7, {100, 200}); // Append
+    assert(seq.query_sum_range(7, 8) == 300);
+    seq.insert_sequence_at(0, {-5}); // Prepend
+    assert(seq.query_sum_range(0, 0) == -5);
+    assert(seq.query_sum_range(0, 9) == 401);
+    seq.insert_sequence_at(3, {});
+    assert(seq.query_sum_range(0, 9) == 401);
+
+    // Test Case 10: Split and Join
+    cout << "\nTest Case 10: Split and Join" << endl;
+    model = {1, 2, 3, 4, 5, 6};
+    seq.build_from_sequence(model);
+    Seq right_part = seq.split(4); // [1, 2, 3, 4] | [5, 6]
+    assert(seq.sequence_size() == 4);
+    assert(right_part.pool == seq.pool && right_part.sequence_size() == 2);
+    assert(right_part.query_sum_range(0, 1) == 11);
+    assert(seq.query_sum_range(0, 3) == 10);
+    right_part.update_range(0, 1, 10); // [15, 16]
+    right_part.join(seq); // [15, 16, 1, 2, 3, 4]
+    assert(seq.sequence_size() == 0 && right_part.sequence_size() == 6);
+    swap(seq, right_part);
+    assert(seq.query_sum_range(0, 5) == 41);
+    assert(seq.query_sum_range(1, 2) == 17);
+    assert(seq.split(6).sequence_size() == 0);
+    Seq whole = seq.split(0);
+    assert(seq.sequence_size() == 0 && whole.sequence_size() == 6);
+    seq.join(whole);
+    assert(seq.query_sum_range(0, 5) == 41);
+    Seq other_pool; // Joining across pools copies the elements
+    other_pool.build_from_sequence({7, 8});
+    seq.join(other_pool);
+    assert(other_pool.sequence_size() == 0 && seq.query_sum_range(5, 7) == 19);
+    assert(other_pool.pool->tot_nodes == 0); // Its own pool is emptied, not stranded
+    {
+        Seq scratch(seq.pool); // Nodes of a sequence on a shared pool are freed with it
+        scratch.build_from_sequence({1, 2, 3});
+    }
+    assert(seq.pool->free_nodes.size() == 1);
+    Seq moved_to = move(other_pool);
+    other_pool.build_from_sequence({3}); // A moved-from instance is a usable empty sequence
+    assert(other_pool.sequence_size() == 1 && other_pool.query_sum_range(0, 0) == 3);
+    other_pool = move(moved_to);
+    assert(other_pool.sequence_size() == 0 && moved_to.sequence_size() == 0);
+    moved_to.insert_at_position(0, 6);
+    assert(moved_to.query_sum_range(0, 0) == 6);
+
+    // Test Case 11: Range Reversal
+    cout << "\nTest Case 11: Range Reversal" << endl;
+    model = {1, 2, 3, 4, 5, 6, 7};
+    seq.build_from_sequence(model);
+    seq.reverse_range(1, 5); // 1, 6, 5, 4, 3, 2, 7
+    assert(seq.query_sum_range(1, 1) == 6);
+    assert(seq.query_sum_range(5, 5) == 2);
+    assert(seq.query_sum_range(1, 2) == 11);
+    seq.update_range(0, 2, 10); // 11, 16, 15, 4, 3, 2, 7
+    seq.reverse_range(0, 6); // 7, 2, 3, 4, 15, 16, 11
+    assert(seq.query_sum_range(0, 0) == 7);
+    assert(seq.query_sum_range(4, 6) == 42);
+    seq.reverse_range(2, 4); // 7, 2, 15, 4, 3, 16, 11
+    seq.insert_at_position(3, 100); // 7, 2, 15, 100, 4, 3, 16, 11
+    seq.delete_at_position(0); // 2, 15, 100, 4, 3, 16, 11
+    assert(seq.query_sum_range(1, 1) == 15);
+    assert(seq.query_sum_range(3, 4) == 7);
+    assert(seq.query_sum_range(0, 6) == 151);
+    seq.reverse_range(3, 3);
+    assert(seq.query_sum_range(3, 3) == 4);
+
+    // Test Case 12: Range Assignment
+    cout << "\nTest Case 12: Range Assignment" << endl;
+    model = {1, 2, 3, 4, 5, 6};
+    seq.build_from_sequence(model);
+    seq.update_range(0, 5, 1); // 2, 3, 4, 5, 6, 7
+    seq.assign_range(1, 4, 10); // 2, 10, 10, 10, 10, 7
+    assert(seq.query_sum_range(0, 5) == 49);
+    seq.update_range(2, 5, 3); // 2, 10, 13, 13, 13, 10
+    assert(seq.query_sum_range(1, 2) == 23);
+    assert(seq.query_sum_range(4, 5) == 23);
+    seq.assign_range(0, 2, -1); // -1, -1, -1, 13, 13, 10
+    seq.update_range(0, 3, 2); // 1, 1, 1, 15, 13, 10
+    assert(seq.query_sum_range(0, 5) == 41);
+    assert(seq.query_sum_range(2, 3) == 16);
+    seq.assign_range(3, 2, 100);
+    assert(seq.query_sum_range(0, 5) == 41);
+
+    // Test Case 13: Affine Range Updates
+    cout << "\nTest Case 13: Affine Range Updates" << endl;
+    model = {1, 2, 3, 4, 5};
+    seq.build_from_sequence(model);
+    seq.affine_range(0, 4, 2, 1); // 3, 5, 7, 9, 11
+    assert(seq.query_sum_range(0, 4) == 35);
+    seq.affine_range(1, 3, -1, 10); // 3, 5, 3, 1, 11
+    assert(seq.query_sum_range(1, 3) == 9);
+    seq.update_range(0, 2, 1); // 4, 6, 4, 1, 11
+    seq.affine_range(2, 4, 3, 0); // 4, 6, 12, 3, 33
+    assert(seq.query_sum_range(2, 2) == 12);
+    assert(seq.query_sum_range(3, 4) == 36);
+    seq.reverse_range(0, 4); // 33, 3, 12, 6, 4
+    seq.assign_range(1, 2, 5); // 33, 5, 5, 6, 4
+    seq.affine_range(0, 3, 2, -1); // 65, 9, 9, 11, 4
+    assert(seq.query_sum_range(0, 0) == 65);
+    assert(seq.query_sum_range(1, 3) == 29);
+    assert(seq.query_sum_range(0, 4) == 98);
+
+    // Test Case 14: Range Min / Max
+    cout << "\nTest Case 14: Range Min / Max" << endl;
+    model = {5, 3, 8, 3, 9, 1, 7};
+    seq.build_from_sequence(model);
+    assert(seq.range_min(0, 6) == 1 && seq.range_argmin(0, 6) == 5);
+    assert(seq.range_max(0, 6) == 9 && seq.range_argmax(0, 6) == 4);
+    assert(seq.range_min(0, 4) == 3 && seq.range_argmin(0, 4) == 1);
+    assert(seq.range_argmin(2, 4) == 3);
+    seq.update_range(0, 3, 10); // 15, 13, 18, 13, 9, 1, 7
+    assert(seq.range_min(0, 3) == 13 && seq.range_max(0, 3) == 18);
+    assert(seq.range_argmax(0, 6) == 2);
+    seq.affine_range(0, 6, -1, 0); // -15, -13, -18, -13, -9, -1, -7
+    assert(seq.range_min(0, 6) == -18 && seq.range_argmin(0, 6) == 2);
+    assert(seq.range_max(0, 6) == -1 && seq.range_argmax(0, 6) == 5);
+    seq.reverse_range(0, 6); // -7, -1, -9, -13, -18, -13, -15
+    assert(seq.range_argmin(0, 6) == 4 && seq.range_argmax(0, 6) == 1);
+    assert(seq.range_argmin(5, 6) == 6);
+    seq.assign_range(2, 5, 0); // -7, -1, 0, 0, 0, 0, -15
+    assert(seq.range_max(0, 6) == 0 && seq.range_argmax(0, 6) == 2);
+    assert(seq.range_argmax(3, 6) == 3);
+    assert(seq.range_min(1, 0) == INT_MAX && seq.range_argmin(1, 0) == -1);
+
+    // Test Case 15: Other Policies
+    cout << "\nTest Case 15: Other Policies" << endl;
+    SumSeq sum_seq;
+    HashSeq hash_seq;
+    sum_seq.build_from_sequence({10, 20, 30, 40, 50});
+    sum_seq.update_range(1, 3, 5);
+    sum_seq.reverse_range(0, 4); // 50, 45, 35, 25, 10
+    assert(sum_seq.query_sum_range(0, 1) == 95);
+    assert(sum_seq.query_sum_range(0, 4) == 165);
+    assert(seq.query_sum_range(0, 6) == -23); // Each instance holds its own sequence
+    hash_seq.build_from_sequence({1, 2, 3, 2, 1, 5});
+    HashSeq::agg_type h = hash_seq.query_range(0, 4);
+    assert(h.fwd == h.bwd);
+    h = hash_seq.query_range(1, 5);
+    assert(h.fwd != h.bwd);
+    hash_seq.reverse_range(3, 5); // 1, 2, 3, 5, 1, 2
+    HashSeq::agg_type a = hash_seq.query_range(0, 1), b = hash_seq.query_range(4, 5);
+    assert(a.fwd == b.fwd && a.pw == b.pw);
+
+    // Test Case 16: Prefix Sum Search
+    cout << "\nTest Case 16: Prefix Sum Search" << endl;
+    model = {3, 0, 2, 5, 1, 4};
+    seq.build_from_sequence(model); // Prefix sums: 3, 3, 5, 10, 11, 15
+    assert(seq.lower_bound_prefix_sum(0) == 0);
+    assert(seq.lower_bound_prefix_sum(3) == 0);
+    assert(seq.lower_bound_prefix_sum(4) == 2);
+    assert(seq.lower_bound_prefix_sum(10) == 3);
+    assert(seq.lower_bound_prefix_sum(11) == 4);
+    assert(seq.lower_bound_prefix_sum(15) == 5);
+    assert(seq.lower_bound_prefix_sum(16) == 6);
+    auto sum_at_most_7 = [](const Seq::agg_type& a) { return a.sum <= 7; };
+    assert(seq.max_right(0, sum_at_most_7) == 3);
+    assert(seq.max_right(1, sum_at_most_7) == 4);
+    assert(seq.max_right(4, sum_at_most_7) == 6);
+    assert(seq.max_right(6, sum_at_most_7) == 6);
+    assert(seq.min_left(6, sum_at_most_7) == 4);
+    assert(seq.min_left(4, sum_at_most_7) == 1);
+    assert(seq.min_left(3, sum_at_most_7) == 0);
+    assert(seq.min_left(0, sum_at_most_7) == 0);
+    auto min_at_least_2 = [](const Seq::agg_type& a) { return a.mn >= 2; };
+    assert(seq.max_right(2, min_at_least_2) == 4);
+    assert(seq.min_left(4, min_at_least_2) == 2);
+    seq.reverse_range(0, 5); // 4, 1, 5, 2, 0, 3
+    seq.update_range(0, 2, 1); // 5, 2, 6, 2, 0, 3
+    assert(seq.lower_bound_prefix_sum(8) == 2);
+    assert(seq.max_right(1, sum_at_most_7) == 2);
+    assert(seq.min_left(6, sum_at_most_7) == 3);
+    assert(seq.query_sum_range(0, 5) == 18);
+
+    // Test Case 17: Ordered-Key Mode
+    cout << "\nTest Case 17: Ordered-Key Mode" << endl;
+    seq.build_from_sequence({});
+    for (int k : {50, 10, 40, 10, 30, 20}) seq.insert_key(k); // 10, 10, 20, 30, 40, 50
+    assert(seq.sequence_size() == 6);
+    assert(seq.kth_smallest(0) == 10 && seq.kth_smallest(1) == 10);
+    assert(seq.kth_smallest(2) == 20 && seq.kth_smallest(5) == 50);
+    assert(seq.count_less(10) == 0 && seq.count_less(11) == 2);
+    assert(seq.count_less(50) == 5 && seq.count_less(100) == 6);
+    assert(seq.lower_bound(25) == 3 && seq.lower_bound(5) == 0);
+    assert(seq.erase_key(10));
+    assert(!seq.erase_key(35));
+    assert(seq.erase_key(50));
+    assert(!seq.erase_key(60));
+    assert(seq.sequence_size() == 4); // 10, 20, 30, 40
+    assert(seq.kth_smallest(0) == 10 && seq.kth_smallest(3) == 40);
+    seq.update_range(0, 3, 5); // 15, 25, 35, 45
+    assert(seq.count_less(30) == 2);
+    assert(seq.query_sum_range(0, 3) == 120);
+    seq.insert_key(-1);
+    assert(seq.kth_smallest(0) == -1 && seq.range_min(0, 4) == -1);
+    assert(seq.kth_smallest(5) == 0 && seq.kth_smallest(-1) == 0); // Out of range: tree untouched
+    assert(seq.sequence_size() == 5 && seq.query_sum_range(0, 4) == 119);
+
+    // Test Case 18: Range Move
+    cout << "\nTest Case 18: Range Move" << endl;
+    model = {0, 1, 2, 3, 4, 5, 6, 7};
+    seq.build_from_sequence(model);
+    seq.move_range(1, 3, 4); // 0, 4, 5, 6, 1, 2, 3, 7
+    assert(seq.query_sum_range(1, 3) == 15);
+    assert(seq.query_sum_range(4, 6) == 6);
+    assert(seq.range_argmax(0, 7) == 7);
+    seq.move_range(4, 7, 0); // 1, 2, 3, 7, 0, 4, 5, 6
+    assert(seq.query_sum_range(0, 0) == 1 && seq.query_sum_range(3, 3) == 7);
+    assert(seq.range_argmin(0, 7) == 4);
+    seq.reverse_range(0, 3); // 7, 3, 2, 1, 0, 4, 5, 6
+    seq.move_range(0, 1, 6); // 2, 1, 0, 4, 5, 6, 7, 3
+    assert(seq.query_sum_range(6, 7) == 10);
+    assert(seq.query_sum_range(0, 2) == 3);
+    seq.move_range(2, 2, 2);
+    assert(seq.query_sum_range(0, 7) == 28 && seq.sequence_size() == 8);
+
+    // Test Case 19: Range Rotation
+    cout << "\nTest Case 19: Range Rotation" << endl;
+    model = {0, 1, 2, 3, 4, 5, 6, 7};
+    seq.build_from_sequence(model);
+    seq.rotate_range(2, 6, 2); // 0, 1, 5, 6, 2, 3, 4, 7
+    assert(seq.range_argmax(2, 6) == 3);
+    assert(seq.query_sum_range(2, 3) == 11);
+    seq.rotate_range(2, 6, -2); // Back to 0..7
+    for (int i = 0; i < 8; ++i) assert(seq.query_sum_range(i, i) == i);
+    seq.rotate_range(0, 7, 11); // Same as 3: 5, 6, 7, 0, 1, 2, 3, 4
+    assert(seq.range_argmin(0, 7) == 3);
+    assert(seq.query_sum_range(0, 2) == 18);
+    seq.rotate_range(0, 7, 8);
+    assert(seq.query_sum_range(0, 0) == 5);
+    seq.rotate_range(4, 4, 1);
+    assert(seq.query_sum_range(4, 4) == 1 && seq.query_sum_range(0, 7) == 28);
+
+    // Test Case 20: Read-Only Queries
+    cout << "\nTest Case 20: Read-Only Queries" << endl;
+    model = {4, 8, 15, 16, 23, 42, 7, 1};
+    seq.build_from_sequence(model);
+    seq.affine_range(1, 5, 2, 1); // 4, 17, 31, 33, 47, 85, 7, 1
+    seq.reverse_range(2, 7);      // 4, 17, 1, 7, 85, 47, 33, 31
+    seq.update_range(0, 3, -1);   // 3, 16, 0, 6, 85, 47, 33, 31
+    seq.reverse_range(0, 4);      // 85, 6, 0, 16, 3, 47, 33, 31
+    int root_before = seq.root;
+    assert(seq.query_sum_range_readonly(0, 7) == 221);
+    assert(seq.query_sum_range_readonly(1, 3) == 22);
+    assert(seq.query_sum_range_readonly(4, 4) == 3);
+    assert(seq.query_sum_range_readonly(3, 6) == 99);
+    assert(seq.query_sum_range_readonly(5, 4) == 0);
+    Seq::agg_type ro = seq.query_range_readonly(1, 6);
+    assert(ro.mn == 0 && ro.mx == 47);
+    assert(seq.root == root_before); // Nothing was splayed
+    for (int l = 0; l < 8; ++l) {
+        for (int r = l; r < 8; ++r) {
+            Seq::agg_type expected = seq.query_range(l, r);
+            Seq::agg_type got = seq.query_range_readonly(l, r);
+            assert(got.sum == expected.sum && got.mn == expected.mn && got.mx == expected.mx);
+        }
+    }
+    hash_seq.build_from_sequence({1, 2, 3, 4, 3, 2, 9});
+    hash_seq.reverse_range(0, 5); // 2, 3, 4, 3, 2, 1, 9
+    HashSeq::agg_type hro = hash_seq.query_range_readonly(0, 4);
+    assert(hro.fwd == hro.bwd && hro.fwd == hash_seq.query_range(0, 4).fwd);
+
+    // Test Case 21: Iterative and Parallel Build
+    cout << "\nTest Case 21: Iterative and Parallel Build" << endl;
+    for (int n = 0; n <= 40; ++n) {
+        model.resize(n);
+        for (int i = 0; i < n; ++i) model[i] = i * i;
+        seq.build_from_sequence(model);
+        assert(seq.sequence_size() == n);
+        for (int i = 0; i < n; ++i) assert(seq.query_sum_range_readonly(i, i) == i * i);
+        if (n) assert(seq.query_sum_range(0, n - 1) == (n - 1) * n * (2 * n - 1) / 6);
+    }
+    model.resize(300000);
+    for (int i = 0; i < (int)model.size(); ++i) model[i] = i % 7;
+    seq.build_from_sequence(model, 4);
+    assert(seq.query_sum_range_readonly(0, 299999) == 899997);
+    assert(seq.query_sum_range(7, 13) == 21);
+    assert(seq.query_sum_range(150000, 150006) == 21);
+    assert(seq.range_argmax(100000, 100020) == 100001);
+    seq.reverse_range(0, 299999);
+    assert(seq.query_sum_range(0, 0) == 299999 % 7);
+
+    // Test Case 22: Flatten
+    cout << "\nTest Case 22: Flatten" << endl;
+    model = {1, 2, 3, 4, 5, 6, 7, 8};
+    seq.build_from_sequence(model);
+    seq.reverse_range(2, 6);      // 1, 2, 7, 6, 5, 4, 3, 8
+    seq.affine_range(0, 4, 2, 0); // 2, 4, 14, 12, 10, 4, 3, 8
+    seq.reverse_range(0, 3);      // 12, 14, 4, 2, 10, 4, 3, 8
+    seq.update_range(3, 7, 1);    // 12, 14, 4, 3, 11, 5, 4, 9
+    vector<int> flat;
+    seq.flatten_range(0, 7, flat);
+    assert(flat == vector<int>({12, 14, 4, 3, 11, 5, 4, 9}));
+    flat = {-1};
+    seq.flatten_range(2, 4, flat);
+    assert(flat == vector<int>({-1, 4, 3, 11}));
+    seq.flatten_range(5, 4, flat);
+    assert(flat.size() == 4);
+    flat.clear();
+    seq.flatten_range(6, 7, flat);
+    assert(flat == vector<int>({4, 9}));
+    assert(seq.query_sum_range(0, 7) == 62);
+
+    // Test Case 23: Wide Sums
+    cout << "\nTest Case 23: Wide Sums" << endl;
+#if SPLAY_SUM_BITS > 32
+    model.assign(100000, 1000000);
+    seq.build_from_sequence(model);
+    assert(seq.query_sum_range(0, 99999) == (splay_sum_t)100000 * 1000000);
+    seq.update_range(0, 49999, 1000000); // 2e6 on the left half
+    assert(seq.query_sum_range(0, 99999) == (splay_sum_t)150000 * 1000000);
+    assert(seq.query_sum_range_readonly(49990, 50009) == (splay_sum_t)30 * 1000000);
+    seq.affine_range(0, 99999, -1, 0);
+    assert(seq.query_sum_range(0, 99999) == -(splay_sum_t)150000 * 1000000);
+    assert(seq.lower_bound_prefix_sum(1) == 100000);
+#endif
+    typedef SplayTree<SumAddPolicy<int>> NarrowSumSeq; // Opt back into 32-bit sums
+    NarrowSumSeq narrow_sum_seq;
+    assert(sizeof(NarrowSumSeq::Payload) < sizeof(SplayTree<SumAddPolicy<long long>>::Payload));
+    narrow_sum_seq.build_from_sequence({1, 2, 3});
+    assert(narrow_sum_seq.query_sum_range(0, 2) == 6);
+
+    // Test Case 24: Hot/Cold Split Layout
+    cout << "\nTest Case 24: Hot/Cold Split Layout" << endl;
+    typedef SplayTree<SumMinMaxAffinePolicy<>, SplitLayout> SplitSeq;
+    SplitSeq split_seq;
+    model = {5, 1, 4, 2, 3, 9, 8, 7, 6};
+    check_matches_reference(split_seq, model);
+
+    // Test Case 25: Index Width
+    cout << "\nTest Case 25: Index Width" << endl;
+    typedef SplayTree<SumMinMaxAffinePolicy<int>, AosLayout, int16_t> TinySeq;
+    typedef SplayTree<SumMinMaxAffinePolicy<>, AosLayout, int64_t> HugeSeq;
+    TinySeq tiny_seq;
+    HugeSeq huge_seq;
+    assert(sizeof(TinySeq::Links) < sizeof(Seq::Links));
+    assert(sizeof(Seq::Links) < sizeof(HugeSeq::Links));
+    assert(tiny_seq.pool->tree.capacity() == (size_t)1 << FIRST_CHUNK_BITS);
+    model.resize(3000);
+    for (int i = 0; i < (int)model.size(); ++i) model[i] = (i * 37) % 101 - 50;
+    check_matches_reference(tiny_seq, model);
+    check_matches_reference(huge_seq, model);
+    // A 16-bit tree holds up to 32767 nodes, across several small chunks; sz of a full
+    // tree's root is the largest value an int16_t can hold.
+    tiny_seq.build_from_sequence(vector<int>(32767, 1));
+    assert(tiny_seq.pool->tot_nodes == 32767 && tiny_seq.links(tiny_seq.root).sz == 32767);
+    assert(tiny_seq.query_sum_range(0, 32766) == 32767);
+    tiny_seq.reverse_range(0, 32766);
+    tiny_seq.move_range(0, 16382, 16384);
+    assert(tiny_seq.sequence_size() == 32767);
+    // At the limit, new elements can only come from the free list.
+    tiny_seq.delete_range(0, 9999);
+    for (int i = 0; i < 10000; ++i) tiny_seq.insert_at_position(i * 2, 2);
+    assert(tiny_seq.pool->tot_nodes == 32767 && tiny_seq.pool->free_nodes.empty());
+    assert(tiny_seq.query_sum_range(0, 32766) == 32767 + 10000);
+    // Freed nodes are shared with another tree on the pool, which renumbers with it.
+    TinySeq tiny_tenant(tiny_seq.pool);
+    tiny_seq.delete_range(0, 16383);
+    tiny_tenant.build_from_sequence(vector<int>(16384, 3));
+    assert(tiny_seq.pool->tot_nodes == 32767);
+    tiny_seq.compact({&tiny_tenant}, VEB_ORDER);
+    assert(tiny_seq.pool->tot_nodes == 32767);
+    assert(tiny_seq.sequence_size() == 16383 && tiny_tenant.sequence_size() == 16384);
+    assert(tiny_tenant.query_sum_range(0, 16383) == 3 * 16384);
+
+    // Test Case 26: Compaction
+    cout << "\nTest Case 26: Compaction" << endl;
+    seq = Seq(); // Sequences from Test Case 10 still share the old pool
+    model.resize(200000);
+    for (int i = 0; i < (int)model.size(); ++i) model[i] = i % 97;
+    seq.build_from_sequence(model);
+    seq.delete_range(0, 149999); // Leaves 150000 dead nodes behind
+    model.erase(model.begin(), model.begin() + 150000);
+    seq.reverse_range(10, 20000);
+    reverse(model.begin() + 10, model.begin() + 20001);
+    seq.update_range(0, 49999, 3);
+    for (int& v : model) v += 3;
+    Seq kept_seq = seq.split(40000); // Keep the last 10000 elements aside
+    vector<int> kept(model.begin() + 40000, model.end());
+    model.resize(40000);
+    seq.compact({&kept_seq});
+    assert(seq.pool->tot_nodes == 50000 && seq.pool->free_nodes.empty());
+    assert(seq.pool->tree.capacity() < 4 * (size_t)CHUNK_SIZE);
+    assert(seq.root == 1 && kept_seq.root == 40001);
+    int next_id = 2; // In BFS order, children are numbered in the order their parents are
+    for (int x = 1; x <= 40000; ++x) {
+        for (int c : seq.links(x).ch) {
+            if (c) assert(c == next_id++);
+        }
+    }
+    flat.clear();
+    seq.flatten_range(0, 39999, flat);
+    assert(flat == model);
+    seq.join(kept_seq);
+    model.insert(model.end(), kept.begin(), kept.end());
+    seq.compact({&kept_seq}, VEB_ORDER); // kept_seq is empty but still on the pool
+    assert(seq.pool->tot_nodes == 50000);
+    flat.clear();
+    seq.flatten_range(0, 49999, flat);
+    assert(flat == model);
+    seq.insert_at_position(123, 7);
+    assert(seq.pool->tot_nodes == 50001);
+    assert(seq.query_sum_range(123, 123) == 7);
+
+    // Test Case 27: Independent Instances
+    cout << "\nTest Case 27: Independent Instances" << endl;
+    vector<shared_ptr<Seq::NodePool>> pools; // One pool per worker thread
+    for (int w = 0; w < 4; ++w) pools.push_back(make_shared<Seq::NodePool>());
+    vector<Seq> tenants;
+    for (int i = 0; i < 1000; ++i) {
+        tenants.emplace_back(pools[i % 4]);
+        tenants[i].build_from_sequence({i, i, i});
+    }
+    for (int i = 0; i < 1000; i += 2) tenants[i].update_range(0, 2, 1);
+    for (int i = 0; i < 1000; ++i) assert(tenants[i].query_sum_range(0, 2) == 3 * i + (i % 2 ? 0 : 3));
+    assert(pools[0]->tot_nodes == 750);
+    vector<Seq> own_pools(1000); // Each empty instance holds only a first, small chunk
+    assert(own_pools[0].pool->tree.capacity() == (size_t)1 << FIRST_CHUNK_BITS);
+    own_pools[0].build_from_sequence(vector<int>(1000, 1));
+    assert(own_pools[0].query_sum_range(0, 999) == 1000 && own_pools[1].sequence_size() == 0);
+    Seq own_pool;
+    own_pool.build_from_sequence({4, 5});
+    assert(own_pool.query_sum_range(0, 1) == 9 && seq.query_sum_range(123, 123) == 7);
+    for (int round = 0; round < 1000; ++round) { // Rebuilds on a shared pool reuse freed nodes
+        tenants[4].build_from_sequence(vector<int>(100, round));
+    }
+    assert(tenants[4].query_sum_range(0, 99) == 99900);
+    assert(pools[0]->tot_nodes <= 750 + 100);
+    tenants[4].build_from_sequence({5, 5, 5});
+    vector<thread> workers; // Instances on different pools can be used concurrently
+    for (int w = 0; w < 4; ++w) {
+        workers.emplace_back([&tenants, w]() {
+            for (int i = w; i < 1000; i += 4) {
+                tenants[i].reverse_range(0, 1);
+                tenants[i].insert_at_position(0, -i);
+            }
+        });
+    }
+    for (thread& worker : workers) worker.join();
+    for (int i = 0; i < 1000; ++i) assert(tenants[i].query_sum_range(0, 3) == 2 * i + (i % 2 ? 0 : 3));
+    vector<Seq*> pool_tenants; // pools[0] is still held by the vector above
+    for (int i = 4; i < 1000; i += 4) pool_tenants.push_back(&tenants[i]);
+    assert(pools[0]->instances == pool_tenants.size() + 1);
+    tenants[0].compact(pool_tenants, VEB_ORDER);
+    assert(pools[0]->tot_nodes == 1000 && pools[0]->free_nodes.empty());
+    for (int i = 0; i < 1000; ++i) assert(tenants[i].query_sum_range(0, 3) == 2 * i + (i % 2 ? 0 : 3));
+
+    // Test Case 28: Huge Page Chunks
+    cout << "\nTest Case 28: Huge Page Chunks" << endl;
+    typedef SplayTree<SumMinMaxAffinePolicy<>, HugePageLayout<SplitLayout>> HugePageSeq;
+    model.resize(150000);
+    for (int i = 0; i < (int)model.size(); ++i) model[i] = i % 101 - 50;
+    {
+        HugePageSeq huge_page_seq;
+        check_matches_reference(huge_page_seq, model);
+        HugePageSeq::Storage& storage = huge_page_seq.pool->tree;
+        assert(storage.hot.capacity() > 150000 && storage.cold.capacity() > 150000);
+#ifdef __linux__
+        // Chunks fill their huge pages exactly, for both halves of the split layout
+        assert(storage.hot.CHUNK_NODES * sizeof(HugePageSeq::Links) % HugePageChunkAllocator::HUGE_PAGE_SIZE == 0);
+        assert(storage.cold.CHUNK_NODES * sizeof(HugePageSeq::Payload) % HugePageChunkAllocator::HUGE_PAGE_SIZE == 0);
+#endif
+        int n = huge_page_seq.sequence_size();
+        vector<int> before, after;
+        huge_page_seq.flatten_range(0, n - 1, before);
+        huge_page_seq.delete_range(0, n - 50001);
+        huge_page_seq.compact(VEB_ORDER); // Moves the nodes to a new set of chunks
+        assert(storage.capacity() == (size_t)CHUNK_SIZE); // Back to a single, full first chunk
+        huge_page_seq.flatten_range(0, 49999, after);
+        assert(after == vector<int>(before.end() - 50000, before.end()));
+    }
 
     cout << "\n--- All tests passed! ---" << endl;
 }
 
 void run_splay_tree_sample() {
     vector<int> initial_data = {10, 20, 30, 40, 50};
-    build_from_sequence(initial_data); 
+    Seq seq;
+    seq.build_from_sequence(initial_data); 
 
-    cout << "Sum of [1, 3] (20,30,40): " << query_sum_range(1, 3) << endl;
+    cout << "Sum of [1, 3] (20,30,40): " << seq.query_sum_range(1, 3) << endl;
 
-    update_range(1, 3, 5);
-    cout << "Sum of [1, 3] (25,35,45): " << query_sum_range(1, 3) << endl;
-    cout << "Sum of [0, 4] (10,25,35,45,50): " << query_sum_range(0, 4) << endl;
+    seq.update_range(1, 3, 5);
+    cout << "Sum of [1, 3] (25,35,45): " << seq.query_sum_range(1, 3) << endl;
+    cout << "Sum of [0, 4] (10,25,35,45,50): " << seq.query_sum_range(0, 4) << endl;
     
-    insert_at_position(2, 100);
-    cout << "Sum of [0, 5]: " << query_sum_range(0, 5) << endl;
-    cout << "Sum of [2, 4] (100,35,45): " << query_sum_range(2, 4) << endl;
+    seq.insert_at_position(2, 100);
+    cout << "Sum of [0, 5]: " << seq.query_sum_range(0, 5) << endl;
+    cout << "Sum of [2, 4] (100,35,45): " << seq.query_sum_range(2, 4) << endl;
 
-    delete_at_position(3);
-    cout << "Sum of [0, 4]: " << query_sum_range(0, 4) << endl;
-    cout << "Sum of [2, 3] (100,45): " << query_sum_range(2, 3) << endl;
+    seq.delete_at_position(3);
+    cout << "Sum of [0, 4]: " << seq.query_sum_range(0, 4) << endl;
+    cout << "Sum of [2, 3] (100,45): " << seq.query_sum_range(2, 3) << endl;
 
-    update_range(0, 4, -10);
-    cout << "Sum of [0, 4]: " << query_sum_range(0, 4) << endl;
+    seq.update_range(0, 4, -10);
+    cout << "Sum of [0, 4]: " << seq.query_sum_range(0, 4) << endl;
     
-    insert_at_position(0, 999);
-    cout << "Sum of [0,0] (999): " << query_sum_range(0,0) << endl;
-    cout << "Sum of [0, 5]: " << query_sum_range(0, 5) << endl;
+    seq.insert_at_position(0, 999);
+    cout << "Sum of [0,0] (999): " << seq.query_sum_range(0,0) << endl;
+    cout << "Sum of [0, 5]: " << seq.query_sum_range(0, 5) << endl;
 
-    int current_num_elements = tree[tree[tree[root].ch[1]].ch[0]].sz;
-    insert_at_position(current_num_elements, 888);
-    cout << "Sum of ["<< current_num_elements << "," << current_num_elements << "] (888): " << query_sum_range(current_num_elements,current_num_elements) << endl;
+    int current_num_elements = seq.sequence_size();
+    seq.insert_at_position(current_num_elements, 888);
+    cout << "Sum of ["<< current_num_elements << "," << current_num_elements << "] (888): " << seq.query_sum_range(current_num_elements,current_num_elements) << endl;
     current_num_elements++;
-    cout << "Sum of [0, " << current_num_elements-1 << "]: " << query_sum_range(0, current_num_elements-1) << endl;
+    cout << "Sum of [0, " << current_num_elements-1 << "]: " << seq.query_sum_range(0, current_num_elements-1) << endl;
     
-    delete_at_position(0);
+    seq.delete_at_position(0);
     current_num_elements--;
-    cout << "Sum of [0, " << current_num_elements-1 << "]: " << query_sum_range(0, current_num_elements-1) << endl;
+    cout << "Sum of [0, " << current_num_elements-1 << "]: " << seq.query_sum_range(0, current_num_elements-1) << endl;
 
-    delete_at_position(current_num_elements-1);
+    seq.delete_at_position(current_num_elements-1);
     current_num_elements--;
-    cout << "Sum of [0, " << current_num_elements-1 << "]: " << query_sum_range(0, current_num_elements-1) << endl;
+    cout << "Sum of [0, " << current_num_elements-1 << "]: " << seq.query_sum_range(0, current_num_elements-1) << endl;
     
 }
 
+#ifdef SPLAY_BENCHMARK
+// Returns the average time in nanoseconds of one call to f() over `iterations` calls.
+template <class F>
+double time_per_op_ns(int iterations, F f) {
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) f();
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+// Counts user-space data TLB read misses of this thread through perf_event_open.
+// Where the counter is unavailable (not Linux, no PMU, perf_event_paranoid), stop() returns -1.
+struct DtlbMissCounter {
+    int fd = -1;
+
+    DtlbMissCounter() {
+#ifdef __linux__
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~DtlbMissCounter() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    long long stop() {
+#ifdef __linux__
+        long long misses;
+        if (fd < 0) return -1;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) == (ssize_t)sizeof(misses)) return misses;
+#endif
+        return -1;
+    }
+};
+
+// Runs f() `iterations` times and prints the time and data TLB misses per call.
+template <class F>
+void report_per_op(const string& label, int iterations, F f) {
+    DtlbMissCounter tlb;
+    tlb.start();
+    double ns = time_per_op_ns(iterations, f);
+    long long misses = tlb.stop();
+    cout << label << ": " << ns << " ns/op, dTLB misses/op: ";
+    if (misses < 0) cout << "n/a" << endl;
+    else cout << (double)misses / iterations << endl;
+}
+
+// Times find_kth descents and top-down splays on a tree of n elements stored with a given layout.
+template <class Tree>
+void benchmark_layout(const char* layout_name, const vector<int>& data, int queries) {
+    int n = (int)data.size();
+    Tree tree;
+    tree.build_from_sequence(data);
+    long long checksum = 0;
+    mt19937 rng(2024);
+    string prefix = "n = " + to_string(n) + ", " + layout_name + ", ";
+    report_per_op(prefix + "find_kth", queries, [&]() {
+        checksum += tree.find_kth(rng() % n + 1);
+    });
+    report_per_op(prefix + "splay", queries, [&]() {
+        tree.root = tree.splay_kth_top_down(tree.root, rng() % n + 1);
+        checksum += tree.root;
+    });
+    report_per_op(prefix + "range sum", queries, [&]() {
+        int l = rng() % n, r = rng() % n;
+        checksum += tree.query_sum_range(min(l, r), max(l, r));
+    });
+    cout << "(checksum " << checksum << ")" << endl;
+}
+
+void run_benchmarks() {
+    cout << "\n--- Splay Tree Benchmarks ---" << endl;
+    const int queries = 1000000;
+    Seq seq;
+
+    for (int n : {100000, 1000000}) {
+        vector<int> data(n, 1);
+        long long checksum = 0;
+
+        // Range isolation with find_kth + bottom-up splay vs single-pass top-down splay
+        for (int top_down = 0; top_down < 2; ++top_down) {
+            seq.build_from_sequence(data);
+            mt19937 rng(12345);
+            double ns = time_per_op_ns(queries, [&]() {
+                int left_rank = rng() % (n - 1) + 1;
+                int right_rank = left_rank + 1 + rng() % (n - left_rank);
+                int right_boundary_node = top_down ? seq.splay_boundaries(left_rank, right_rank)
+                                                   : seq.splay_boundaries_bottom_up(left_rank, right_rank);
+                checksum += seq.payload(seq.links(right_boundary_node).ch[0]).agg.sum;
+            });
+            cout << "n = " << n << ", range isolation, " << (top_down ? "top-down " : "bottom-up")
+                 << ": " << ns << " ns/op" << endl;
+        }
+        cout << "(checksum " << checksum << ")" << endl;
+    }
+
+    // Cold start: recursive pre-order build vs iterative in-order build, single and multi-threaded
+    const int build_n = 4000000;
+    vector<int> data(build_n);
+    for (int i = 0; i < build_n; ++i) data[i] = i % 1000;
+    vector<int> thread_counts = {1};
+    if (thread::hardware_concurrency() > 1) thread_counts.push_back((int)thread::hardware_concurrency());
+    double ms = time_per_op_ns(1, [&]() {
+        seq.build_from_sequence({});
+        seq.root = seq.build_recursive(data, 0, build_n - 1, 0);
+    }) / 1e6;
+    cout << "n = " << build_n << ", build, recursive: " << ms << " ms" << endl;
+    for (int threads : thread_counts) {
+        ms = time_per_op_ns(1, [&]() { seq.build_from_sequence(data, threads); }) / 1e6;
+        cout << "n = " << build_n << ", build, iterative, " << threads << " thread(s): " << ms << " ms" << endl;
+    }
+
+    // Node layouts at 10^7 nodes
+    data.resize(10000000);
+    for (int i = 0; i < (int)data.size(); ++i) data[i] = i % 1000;
+    benchmark_layout<SplayTree<SumMinMaxAffinePolicy<>, AosLayout>>("array of structs", data, queries);
+    benchmark_layout<SplayTree<SumMinMaxAffinePolicy<>, SplitLayout>>("hot/cold split", data, queries);
+    benchmark_layout<SplayTree<SumMinMaxAffinePolicy<>, HugePageLayout<AosLayout>>>("AoS, huge pages", data, queries);
+    benchmark_layout<SplayTree<SumMinMaxAffinePolicy<>, HugePageLayout<SplitLayout>>>("split, huge pages", data, queries);
+    cout << "(huge page chunks: " << HugePageChunkAllocator::hugetlb_chunks << " from the huge page pool, "
+         << HugePageChunkAllocator::advised_chunks << " advised)" << endl;
+
+    // find_kth after the node IDs have been scattered by rotations, then after compaction
+    {
+        const int n = 1000000;
+        vector<int> ones(n, 1);
+        seq.build_from_sequence(ones);
+        mt19937 rng(7);
+        for (int i = 0; i < n; ++i) {
+            seq.delete_at_position(rng() % n);
+            seq.insert_at_position(rng() % n, 1);
+            int l = rng() % n, r = rng() % n;
+            seq.move_range(min(l, r), max(l, r), 0);
+        }
+        long long checksum = 0;
+        const char* names[] = {"scattered", "BFS order", "vEB order"};
+        for (int pass = 0; pass < 3; ++pass) {
+            if (pass) seq.compact(pass == 1 ? BFS_ORDER : VEB_ORDER);
+            double ns = time_per_op_ns(queries, [&]() { checksum += seq.find_kth(rng() % n + 1); });
+            cout << "n = " << n << ", find_kth, " << names[pass] << ": " << ns << " ns/op" << endl;
+        }
+        cout << "(checksum " << checksum << ")" << endl;
+    }
+
+    // Index widths on a small tree
+    data.resize(30000);
+    benchmark_layout<SplayTree<SumMinMaxAffinePolicy<int>, SplitLayout, int16_t>>("16-bit IDs", data, queries);
+    benchmark_layout<SplayTree<SumMinMaxAffinePolicy<int>, SplitLayout, int32_t>>("32-bit IDs", data, queries);
+    benchmark_layout<SplayTree<SumMinMaxAffinePolicy<int>, SplitLayout, int64_t>>("64-bit IDs", data, queries);
+}
+#endif
 
 int main() {
     run_tests();
     run_splay_tree_sample();
+#ifdef SPLAY_BENCHMARK
+    run_benchmarks();
+#endif
     return 0;
 }
\ No newline at end of file